@@ -0,0 +1,29 @@
+#pragma once
+
+#include <limits>
+
+#include <glm/glm.hpp>
+
+struct Aabb {
+    glm::vec3 min = glm::vec3(std::numeric_limits<float>::max());
+    glm::vec3 max = glm::vec3(-std::numeric_limits<float>::max());
+
+    Aabb() = default;
+    Aabb(const glm::vec3& min, const glm::vec3& max) : min(min), max(max) {};
+
+    void expand(const glm::vec3& p) { min = glm::min(min, p); max = glm::max(max, p); };
+    void expand(const Aabb& other) { min = glm::min(min, other.min); max = glm::max(max, other.max); };
+    Aabb inflated(float margin) const { return Aabb(min - margin, max + margin); };
+
+    bool overlaps(const Aabb& other) const {
+        return glm::all(glm::lessThanEqual(min, other.max)) && glm::all(glm::lessThanEqual(other.min, max));
+    };
+    bool contains(const glm::vec3& p) const {
+        return glm::all(glm::lessThanEqual(min, p)) && glm::all(glm::lessThanEqual(p, max));
+    };
+    // Zero inside, a lower bound on the distance to anything in the box otherwise
+    float distanceTo(const glm::vec3& p) const {
+        return glm::length(glm::max(glm::max(min - p, p - max), glm::vec3(0.0f)));
+    };
+    bool isEmpty() const { return min.x > max.x; };
+};
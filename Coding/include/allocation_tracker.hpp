@@ -0,0 +1,109 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Heap accounting through replaced global operator new / delete, for finding allocations in
+//  the per-step and per-frame paths. Build with -DCLOTH_TRACK_ALLOCATIONS=ON to count; otherwise
+//  every figure reads zero and the scopes cost nothing.
+
+struct AllocationStats {
+    uint64_t allocations = 0; // operator new calls
+    uint64_t bytes = 0; // requested by them
+    uint64_t liveBytes = 0; // allocated and not yet freed
+    uint64_t peakBytes = 0; // highest liveBytes so far
+};
+
+// Process-wide, from all threads
+AllocationStats allocationStats();
+
+// Counts the allocations of every thread while it lives, and adds them to 'subsystem's totals
+//  for printAllocationReport(); 'subsystem' must outlive the report (e.g. a literal)
+class AllocationScope {
+private:
+    const char* subsystem;
+    AllocationStats start;
+
+public:
+    explicit AllocationScope(const char* subsystem);
+    ~AllocationScope();
+    AllocationScope(const AllocationScope&) = delete;
+    AllocationScope& operator=(const AllocationScope&) = delete;
+
+    // Since construction
+    uint64_t allocations() const;
+    uint64_t bytes() const;
+};
+
+// Allocations, bytes and the peak reached of every subsystem so far, and the process peak
+void printAllocationReport();
+
+#ifdef CLOTH_TRACK_ALLOCATIONS
+// The next allocation (of any thread) is intended, the hot path guards do not count it
+void expectAllocation();
+#else
+inline void expectAllocation() {}
+#endif
+
+// push_back into a buffer that keeps its capacity across steps, whose size depends on the
+//  scene (e.g. contacts): reaching a new high-water mark allocates, but is expected
+template <typename T>
+inline void pushScratch(std::vector<T>& buffer, const T& value) {
+    if (buffer.size() == buffer.capacity()) {
+        expectAllocation();
+    }
+    buffer.push_back(value);
+}
+
+// Same for appending a range, growing geometrically like push_back
+template <typename T, typename Iterator>
+inline void appendScratch(std::vector<T>& buffer, Iterator first, Iterator last) {
+    size_t size = buffer.size() + (size_t)(last - first);
+    if (size > buffer.capacity()) {
+        expectAllocation();
+        buffer.reserve(std::max(size, 2 * buffer.capacity()));
+    }
+    buffer.insert(buffer.end(), first, last);
+}
+
+// resize / assign of such a buffer, for ones sized on first use rather than construction
+template <typename T>
+inline void resizeScratch(std::vector<T>& buffer, size_t size) {
+    if (size > buffer.capacity()) {
+        expectAllocation();
+    }
+    buffer.resize(size);
+}
+
+template <typename T>
+inline void assignScratch(std::vector<T>& buffer, size_t size, const T& value) {
+    if (size > buffer.capacity()) {
+        expectAllocation();
+    }
+    buffer.assign(size, value);
+}
+
+#ifdef CLOTH_TRACK_ALLOCATIONS
+// Aborts with a message if the enclosing scope made an allocation that was not expected, once
+//  'skip' runs have passed (scratch buffers are sized on the first runs); 'runs' counts them and
+//  belongs to the object whose buffers they are, 'name' must be a literal
+#define CLOTH_ASSERT_NO_ALLOCATIONS(name, runs, skip) \
+    NoAllocationGuard allocationGuard_(name, (runs)++ >= (skip))
+
+class NoAllocationGuard {
+private:
+    const char* name;
+    bool armed;
+    uint64_t start, expectedStart;
+
+public:
+    NoAllocationGuard(const char* name, bool armed);
+    ~NoAllocationGuard();
+    NoAllocationGuard(const NoAllocationGuard&) = delete;
+    NoAllocationGuard& operator=(const NoAllocationGuard&) = delete;
+};
+#else
+#define CLOTH_ASSERT_NO_ALLOCATIONS(name, runs, skip) ((void)0)
+#endif
@@ -4,6 +4,7 @@
 #include <vector>
 
 #include "camera.hpp"
+#include "collider.hpp"
 #include "shader.hpp"
 
 class BallRenderer {
@@ -55,16 +56,22 @@ private:
 
     Shader* shader;
     FirstPersonCamera* camera;
-    glm::vec3 center = glm::vec3(0.1f, -2.0f, -0.3f);
-    float radius = 0.98f;
+    // The sphere is read from the collider set every draw, so it follows the simulation
+    const ColliderSet* colliders;
+    unsigned int colliderIdx;
+    float shrink = 0.98f; // drawn slightly inside, so that resting cloth is not hidden
     unsigned int segments = 20;
+    std::vector<VertexData> unitSphere;
 
     GLObject glo;
+    unsigned int drawRuns = 0; // for the allocation guard's warm-up
 
 public:
     BallRenderer(
         Shader* shader,
-        FirstPersonCamera* camera
+        FirstPersonCamera* camera,
+        const ColliderSet* colliders,
+        unsigned int colliderIdx
     );
     ~BallRenderer() = default;
 
@@ -73,6 +80,7 @@ public:
 private:
     void initVertices();
     void initIndices();
+    void updateVertices();
 
     static glm::vec3 calcNormal(
         const glm::vec3& v1,
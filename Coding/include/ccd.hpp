@@ -0,0 +1,25 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+// Continuous collision tests for linear motion over one step, t in [0, 1].
+// Both solve the coplanarity cubic of the four points and accept the earliest
+// root at which the primitives are closer than 'thickness'.
+
+// Vertex p against triangle (a, b, c); '0' positions are at the start of the step, '1' at the end
+bool vertexTriangleCcd(
+    const glm::vec3& p0, const glm::vec3& a0, const glm::vec3& b0, const glm::vec3& c0,
+    const glm::vec3& p1, const glm::vec3& a1, const glm::vec3& b1, const glm::vec3& c1,
+    float thickness, float& toi);
+
+// Edge (a, b) against edge (c, d)
+bool edgeEdgeCcd(
+    const glm::vec3& a0, const glm::vec3& b0, const glm::vec3& c0, const glm::vec3& d0,
+    const glm::vec3& a1, const glm::vec3& b1, const glm::vec3& c1, const glm::vec3& d1,
+    float thickness, float& toi);
+
+// Closest points of segments (p0, p1) and (q0, q1), as segment parameters
+float segmentSegmentDistance(
+    const glm::vec3& p0, const glm::vec3& p1,
+    const glm::vec3& q0, const glm::vec3& q1,
+    float& s, float& t);
@@ -5,10 +5,21 @@
 #include <glm/mat4x4.hpp>
 #include <glm/vec3.hpp>
 
+#include "memory_footprint.hpp"
+
 struct RectCloth {
 private:
     std::vector<glm::vec3> positions;
 
+    // Two triangles per grid quad, shared by the renderer and the simulator
+    std::vector<glm::uvec3> triangles;
+    // Area weighted face normals (length is twice the triangle area), computed lazily
+    std::vector<glm::vec3> faceNormals;
+    bool faceNormalsValid = false;
+    // Torn triangles keep their slot (the quad layout stays valid) but are flagged, and logged in order
+    std::vector<unsigned char> torn;
+    std::vector<unsigned int> tornTriangles;
+
 public:
     const float dx;
     const unsigned int nw;
@@ -28,7 +39,29 @@ public:
 
     glm::vec3& getPosition(unsigned int idx) { return positions[idx]; };
     glm::vec3& getPosition(unsigned int iw, unsigned int ih) { return positions[idxFromCoord(iw, ih)]; };
+    const std::vector<glm::vec3>& getPositions() const { return positions; };
+
+    void setPosition(unsigned int idx, const glm::vec3& value) { positions[idx] = value; faceNormalsValid = false; };
+    void setPosition(unsigned int iw, unsigned int ih, const glm::vec3& value) { setPosition(idxFromCoord(iw, ih), value); };
+
+    // Triangle 2 * q is (leftDown, rightDown, rightUp) and 2 * q + 1 is (leftDown, rightUp, leftUp) of quad q
+    const std::vector<glm::uvec3>& getTriangles() const { return triangles; };
+    const std::vector<glm::vec3>& getFaceNormals(); // zero for torn triangles
 
-    void setPosition(unsigned int idx, const glm::vec3& value) { positions[idx] = value; };
-    void setPosition(unsigned int iw, unsigned int ih, const glm::vec3& value) { positions[idxFromCoord(iw, ih)] = value; };
-};
\ No newline at end of file
+    // The (up to two) triangles with edge (a, b), torn or not, written to 'found'; returns how many
+    unsigned int findEdgeTriangles(unsigned int a, unsigned int b, unsigned int found[2]) const;
+    // Tearing: remove the (up to two) triangles with edge (a, b), written to 'removed'; returns how many
+    unsigned int tearEdge(unsigned int a, unsigned int b, unsigned int removed[2]);
+    bool isTorn(unsigned int triangle) const { return torn[triangle] != 0; };
+    // Every torn triangle in the order it tore, consumers remember how far they have read
+    const std::vector<unsigned int>& getTornTriangles() const { return tornTriangles; };
+
+    // Sum a per-triangle quantity onto the vertices of each triangle
+    void gatherToVertices(const std::vector<glm::vec3>& perTriangle, std::vector<glm::vec3>& perVertex) const;
+
+    // Positions count as a vertex copy, the cached face normals as scratch
+    MemoryFootprint memoryFootprint() const;
+
+private:
+    void initTriangles();
+};
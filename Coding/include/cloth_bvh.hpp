@@ -0,0 +1,112 @@
+#pragma once
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "aabb.hpp"
+#include "cloth.hpp"
+
+// Bounding volume hierarchy over the triangles of a RectCloth.
+// The tree is built once by splitting the quad grid, since triangles keep their slots
+// even when torn (queries skip those); every step it is only refit bottom-up, one
+// parallel pass per level.
+class ClothBvh {
+public:
+    struct Node {
+        Aabb bounds;
+        int left = -1; // -1 for leaves
+        int right = -1;
+        // Quads [iw0, iw1) x [ih0, ih1) below this node
+        unsigned int iw0, ih0, iw1, ih1;
+
+        bool isLeaf() const { return left < 0; };
+    };
+
+    struct RayHit {
+        float t;
+        unsigned int triangle;
+        glm::vec3 barycentric;
+    };
+
+private:
+    RectCloth* cloth;
+    std::vector<Node> nodes; // nodes[0] is the root
+    std::vector<std::vector<unsigned int>> levels; // node indices by depth
+    const std::vector<glm::vec3>* positions = nullptr; // from the last refit
+    unsigned int leafQuads;
+
+public:
+    ClothBvh(RectCloth* cloth, unsigned int leafQuads = 4);
+    ~ClothBvh() = default;
+
+    // Recompute the bounds for new positions, optionally inflated (e.g. by a contact thickness)
+    void refit(const std::vector<glm::vec3>& positions, float margin = 0.0f);
+    // Bounds that enclose both position sets, for swept queries over a step
+    void refit(const std::vector<glm::vec3>& positions, const std::vector<glm::vec3>& previousPositions, float margin = 0.0f);
+
+    const Aabb& bounds() const { return nodes[0].bounds; };
+    const std::vector<Node>& getNodes() const { return nodes; };
+    size_t memoryBytes() const { return vectorBytes(nodes) + vectorBytes(levels); };
+
+    // Call 'visit(triangleIdx)' for every triangle whose leaf overlaps the box
+    template <typename Visitor>
+    void query(const Aabb& box, Visitor&& visit) const {
+        unsigned int stack[64];
+        unsigned int top = 0;
+        stack[top++] = 0;
+        while (top > 0) {
+            const Node& node = nodes[stack[--top]];
+            if (!node.bounds.overlaps(box)) {
+                continue;
+            }
+            if (node.isLeaf()) {
+                forEachTriangle(node, visit);
+            } else {
+                stack[top++] = (unsigned int)node.left;
+                stack[top++] = (unsigned int)node.right;
+            }
+        }
+    };
+
+    // Nearest triangle hit along the ray, within [0, maxT]
+    bool raycast(const glm::vec3& origin, const glm::vec3& direction, RayHit& hit, float maxT = 1e30f) const;
+    // Nearest vertex to p closer than maxDistance, best first with pruning by box distance
+    bool nearestVertex(const glm::vec3& p, unsigned int& vertex, float& distance, float maxDistance = 1e30f) const;
+    // Every vertex within 'radius' of 'center', appended to 'found'
+    void verticesWithin(const glm::vec3& center, float radius, std::vector<unsigned int>& found) const;
+
+    template <typename Visitor>
+    void forEachTriangle(const Node& node, Visitor&& visit) const {
+        const unsigned int nq = cloth->nw - 1;
+        for (unsigned int ih = node.ih0; ih < node.ih1; ih++) {
+            for (unsigned int iw = node.iw0; iw < node.iw1; iw++) {
+                unsigned int q = ih * nq + iw;
+                if (!cloth->isTorn(2 * q)) {
+                    visit(2 * q);
+                }
+                if (!cloth->isTorn(2 * q + 1)) {
+                    visit(2 * q + 1);
+                }
+            }
+        }
+    };
+
+    // Vertices owned by the node: a leaf owns its quads' lower-left corners, and the last
+    //  row and column of the grid along the cloth's border, so every vertex has one owner
+    template <typename Visitor>
+    void forEachVertex(const Node& node, Visitor&& visit) const {
+        const unsigned int nw = cloth->nw;
+        const unsigned int ihEnd = node.ih1 == cloth->nh - 1 ? node.ih1 + 1 : node.ih1;
+        const unsigned int iwEnd = node.iw1 == nw - 1 ? node.iw1 + 1 : node.iw1;
+        for (unsigned int ih = node.ih0; ih < ihEnd; ih++) {
+            for (unsigned int iw = node.iw0; iw < iwEnd; iw++) {
+                visit(ih * nw + iw);
+            }
+        }
+    };
+
+private:
+    int build(unsigned int iw0, unsigned int ih0, unsigned int iw1, unsigned int ih1, unsigned int depth);
+    void refitLevels(const std::vector<glm::vec3>& positions, const std::vector<glm::vec3>* previousPositions, float margin);
+};
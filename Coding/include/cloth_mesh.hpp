@@ -0,0 +1,69 @@
+#pragma once
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "cloth.hpp"
+#include "memory_footprint.hpp"
+
+// The CPU side of drawing a cloth: interleaved vertices and the live triangles' indices, kept
+//  up to date from the cloth without any GL dependency, so it can be measured on its own
+class ClothMesh {
+public:
+    struct Vertex {
+        glm::vec3 position;
+        glm::vec3 normal;
+    };
+    // The normal as signed normalised 10:10:10:2 (GL_INT_2_10_10_10_REV), 16 instead of 24 bytes
+    struct PackedVertex {
+        glm::vec3 position;
+        glm::uint32 normal;
+    };
+
+private:
+    RectCloth* cloth;
+
+    std::vector<Vertex> vertices;
+    std::vector<PackedVertex> packedVertices; // in place of 'vertices' once packed
+    bool packed = false;
+    std::vector<unsigned int> indices;
+    std::vector<glm::vec3> vertexNormals; // scratch for normal accumulation
+
+    // The index array holds the live triangles compacted at its front, one slot of three indices each
+    std::vector<unsigned int> triangleSlots; // slot of every cloth triangle, while it is live
+    std::vector<unsigned int> slotTriangles; // triangle in every slot
+    unsigned int liveTriangles = 0;
+    unsigned int tearsSeen = 0; // how far the cloth's torn triangle log has been applied
+    unsigned int dirtyBegin = 0, dirtyEnd = 0; // slots changed since the last clearDirty()
+
+public:
+    explicit ClothMesh(RectCloth* cloth);
+
+    const std::vector<Vertex>& getVertices() const { return vertices; }; // empty when packed
+    const std::vector<PackedVertex>& getPackedVertices() const { return packedVertices; };
+    bool isPacked() const { return packed; };
+    // Whichever vertex array is in use, for upload
+    const void* getVertexData() const;
+    size_t getVertexBytes() const;
+    size_t getVertexStride() const { return packed ? sizeof(PackedVertex) : sizeof(Vertex); };
+    // Switch the vertex layout, the vertices are refreshed in the new one
+    void setPackedNormals(bool value);
+    // Vertices, indices and their bookkeeping; the GPU copies are the renderer's to count
+    MemoryFootprint memoryFootprint() const;
+    const std::vector<unsigned int>& getIndices() const { return indices; };
+    unsigned int getLiveTriangles() const { return liveTriangles; };
+
+    // Slot range [begin, end) whose indices changed, empty when begin == end
+    unsigned int getDirtyBegin() const { return dirtyBegin; };
+    unsigned int getDirtyEnd() const { return dirtyEnd; };
+    void clearDirty() { dirtyBegin = dirtyEnd = 0; };
+
+    void updatePositions();
+    void updateNormals() { accumulateNormals(); normalizeNormals(); };
+    // The two halves of updateNormals: area weighted face normals summed per vertex, then normalised
+    void accumulateNormals();
+    void normalizeNormals();
+    void initIndices();
+    void updateIndices();
+};
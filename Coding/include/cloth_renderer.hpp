@@ -1,24 +1,19 @@
 #pragma once
 
-#include <array>
-
 #include <glm/glm.hpp>
 
 #include "camera.hpp"
 #include "shader.hpp"
 #include "cloth.hpp"
+#include "cloth_mesh.hpp"
 
 class RectClothRenderer {
 private:
-    struct VertexData {
-        glm::vec3 position;
-        glm::vec3 normal;
-    };
-
     struct GLObject {
         GLuint VAO;
-        GLuint VBO; std::vector<VertexData> vertices;
-        GLuint EBO; std::vector<GLuint> indices;
+        GLuint VBO;
+        GLuint EBO;
+        size_t vertexBytes = 0, indexBytes = 0; // as last allocated
 
         GLObject() {
             glGenVertexArrays(1, &VAO);
@@ -30,25 +25,37 @@ private:
             glDeleteBuffers(1, &EBO);
             glDeleteVertexArrays(1, &VAO);
         };
-        void initData() {
+        void initData(const ClothMesh& mesh) {
+            const std::vector<unsigned int>& indices = mesh.getIndices();
+            vertexBytes = mesh.getVertexBytes();
+            indexBytes = sizeof(GLuint) * indices.size();
+
             glBindVertexArray(VAO);
             glBindBuffer(GL_ARRAY_BUFFER, VBO);
             glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
 
-            glBufferData(GL_ARRAY_BUFFER, sizeof(VertexData) * vertices.size(), vertices.data(), GL_STREAM_DRAW);
-            glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * indices.size(), indices.data(), GL_STATIC_DRAW);
+            glBufferData(GL_ARRAY_BUFFER, vertexBytes, mesh.getVertexData(), GL_STREAM_DRAW);
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBytes, indices.data(), GL_DYNAMIC_DRAW);
 
+            // Both layouts start with the position
             glEnableVertexAttribArray(0);
             glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE,
-                sizeof(VertexData),
-                (void*)offsetof(VertexData, position)
+                (GLsizei)mesh.getVertexStride(),
+                (void*)offsetof(ClothMesh::Vertex, position)
             );
 
             glEnableVertexAttribArray(1);
-            glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE,
-                sizeof(VertexData),
-                (void*)offsetof(VertexData, normal)
-            );
+            if (mesh.isPacked()) {
+                glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE,
+                    sizeof(ClothMesh::PackedVertex),
+                    (void*)offsetof(ClothMesh::PackedVertex, normal)
+                );
+            } else {
+                glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE,
+                    sizeof(ClothMesh::Vertex),
+                    (void*)offsetof(ClothMesh::Vertex, normal)
+                );
+            }
 
             glBindBuffer(GL_ARRAY_BUFFER, 0);
             glBindVertexArray(0);
@@ -59,7 +66,10 @@ private:
     FirstPersonCamera* camera;
     RectCloth* cloth;
 
+    // Vertex and index preparation, the GL objects only mirror it
+    ClothMesh mesh;
     GLObject glo;
+    unsigned int drawRuns = 0; // for the allocation guard's warm-up
 
 public:
     RectClothRenderer(
@@ -71,15 +81,10 @@ public:
 
     void draw();
 
-private:
-    void initVertices();
-    void updatePositions();
-    void updateNormals();
-    void initIndices();
-
-    static glm::vec3 calcNormal(
-        const glm::vec3& v1,
-        const glm::vec3& v2,
-        const glm::vec3& v3
-    ) { return glm::normalize(glm::cross(v2 - v1, v3 - v1)); };
-};
\ No newline at end of file
+    // The mesh and its GL buffers; the cloth itself is counted by its simulator
+    MemoryFootprint memoryFootprint() const;
+    // Optional limit on memoryFootprint().total(), 0 for none, checked when set: past it, normals
+    //  are packed to 10:10:10:2 (a third less vertex memory on both sides). Returns whether the
+    //  footprint is within the budget afterwards.
+    bool setMemoryBudget(size_t bytes);
+};
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <vector>
+
+#include "aabb.hpp"
+#include "cloth_simulator.hpp"
+
+// Several independently simulated cloths that collide with each other.
+// Every step each simulator solves its step on its own; then the cloths' bounding
+// boxes go through a sweep and prune on x, only the overlapping pairs get a
+// particle-triangle narrowphase in both directions through each other's BVH, and
+// the steps finish with the contacts applied.
+class ClothScene {
+private:
+    std::vector<RectClothSimulator*> simulators; // not owned
+    std::vector<Aabb> bounds; // per cloth, inflated by the thickness
+    std::vector<unsigned int> order; // cloths by bounds.min.x, kept sorted across steps
+    std::vector<glm::uvec2> pairs; // overlapping this step
+
+public:
+    float thickness;
+
+    ClothScene(float thickness = 0.02f);
+    ~ClothScene() = default;
+
+    void add(RectClothSimulator* simulator);
+    void step(float timeStep);
+
+    const std::vector<glm::uvec2>& getPairs() const { return pairs; };
+
+private:
+    void findPairs();
+};
@@ -1,11 +1,35 @@
 #pragma once
 
+#include <mutex>
+
 #include "cloth.hpp"
+#include "cloth_bvh.hpp"
+#include "collider.hpp"
+#include "spatial_hash.hpp"
+#include "step_observer.hpp"
+#include "wind_field.hpp"
+#include "wind_grid.hpp"
+
+// Figures of one step, gathered by the passes that already visit the springs and particles
+struct StepHealth {
+    unsigned long long step = 0; // steps taken, 0 before the first
+    float time = 0.0f; // simulated seconds at the end of the step
+    float maxStrain = 0.0f; // largest |length / rest length - 1| over the springs
+    float meanStrain = 0.0f;
+    double kineticEnergy = 0.0;
+    unsigned int contacts = 0; // collider, triangle, self and barrier contacts
+    unsigned int pinned = 0; // anchored or grabbed particles
+    // Barrier step only: Newton and (summed) CG iterations, and the last Newton step relative to
+    //  the convergence tolerance, below 1 once converged
+    unsigned int newtonIterations = 0;
+    unsigned int cgIterations = 0;
+    float newtonResidual = 0.0f;
+};
 
 class RectClothSimulator {
 private:
+    // Positions live in their own array (see 'positions') so that batch passes can stream them
     struct MassParticle {
-        glm::vec3 position;
         std::vector<unsigned int> connectedSpringStartIndices;
         std::vector<unsigned int> connectedSpringEndIndices;
 
@@ -32,15 +56,112 @@ private:
 
     RectCloth* cloth;
     std::vector<MassParticle> particles;
+    std::vector<glm::vec3> positions;
     std::vector<Spring> springs;
 
     // Simulation parameters
+    float time = 0.0f; // simulated seconds, advanced by step()
+    unsigned int solveRuns = 0, finishRuns = 0; // for the allocation guards' warm-up
     glm::vec3 gravity;
     float airResistanceCoefficient; // Per-particle
 
-    // collision parameters
-    float collision_radius = 1.0f;
-    glm::vec3 center = glm::vec3(0.1f, -2.0f, -0.3f);
+    // collision parameters, the collider set is not owned
+    ColliderSet* colliders = nullptr;
+    unsigned int collisionTileRows = 4; // rows per broadphase tile
+    ContactCache contactCache;
+
+    // Triangle hierarchy, refit lazily after the positions change
+    ClothBvh bvh;
+    bool bvhValid = false;
+
+    // self-collision parameters
+    float selfCollisionThickness; // set from the cloth spacing
+    SpatialHash selfCollisionHash;
+    std::vector<glm::vec3> positionCorrections; // scratch
+    std::vector<glm::vec3> velocityCorrections; // scratch
+
+    std::vector<glm::vec4> contactCorrections; // scratch, from the triangle collider pass
+
+    // Contacts with other cloths, accumulated by collideWith() (xyz) with a count (w)
+    std::vector<glm::vec4> clothPositionCorrections;
+    std::vector<glm::vec3> clothVelocityCorrections;
+
+    // continuous collision parameters
+    float ccdThickness; // set from the cloth spacing
+    std::vector<glm::vec3> previousPositions; // at the start of the step
+    std::vector<glm::vec4> impulseCorrections; // scratch, velocity changes of the impacts (xyz) with a count (w)
+    std::vector<glm::vec3> hitNormals; // scratch
+    std::vector<glm::uvec2> edges; // unique triangle edges
+    std::vector<unsigned char> deadEdges; // per edge, 1 once no triangle has it; removed by compactEdges()
+    unsigned int deadEdgeCount = 0;
+    std::vector<float> vertexImpactTimes; // scratch, earliest impact per vertex
+    std::vector<unsigned int> vertexImpactTriangles; // scratch
+    std::vector<float> edgeImpactTimes; // scratch, earliest impact per edge
+    std::vector<unsigned int> edgeImpactEdges; // scratch
+    std::vector<unsigned char> ownedEdges; // per triangle, bit k: edge (k, k + 1) is listed by this triangle first
+
+    // barrier (implicit, intersection free) parameters
+    struct BarrierContact {
+        // Distance d = dot(normal, sum(weights[k] * positions[vertices[k]])), exact to first order
+        unsigned int vertices[4];
+        float weights[4];
+        glm::vec3 normal;
+        float distance;
+        int collider; // -1 for self contact
+    };
+    float barrierDistance; // set from the cloth spacing, contacts act below it
+    float barrierStiffness; // set from the particle weight
+    unsigned int maxNewtonIterations = 8;
+    unsigned int maxCgIterations = 100;
+    std::vector<BarrierContact> barrierContacts; // at the current iterate
+    std::vector<std::vector<BarrierContact>> barrierTileContacts; // scratch, one list per row
+    std::vector<Aabb> colliderBoxes; // scratch, for the step
+    std::vector<glm::vec3> inertiaTargets; // scratch, x + h v + h^2 a
+    std::vector<glm::vec3> trialPositions; // scratch, line search
+    std::vector<glm::vec3> newtonGradient; // scratch
+    std::vector<glm::vec3> newtonDirection; // scratch
+    std::vector<glm::mat3> springHessians; // scratch
+    std::vector<glm::mat3> blockPreconditioner; // scratch, inverse diagonal blocks
+    std::vector<glm::vec3> cgResidual, cgPreconditioned, cgSearch, cgProduct; // scratch
+
+    // drag constraint, moves one particle toward a target every step
+    int dragParticle = -1; // none
+    glm::vec3 dragTarget = glm::vec3(0.0f);
+    float dragResponse = 0.05f; // seconds, the gap closes exponentially at this rate
+
+    // tearing parameters
+    float tearStrain = 0.5f; // springs break once stretched past (1 + tearStrain) times their rest length
+
+    // wind parameters
+    WindField windField;
+    float windScale = 0.01f;
+    std::vector<glm::vec3> windForces; // scratch, reused every step
+
+    // aerodynamics parameters (per-triangle drag and lift)
+    float airDensity = 1.2f;
+    float dragCoefficient = 1.0f;
+    float liftCoefficient = 0.6f;
+    std::vector<glm::vec3> triangleCentroids; // scratch
+    std::vector<glm::vec3> triangleVelocities; // scratch
+    std::vector<glm::vec3> airVelocities; // scratch
+    std::vector<glm::vec3> triangleForces; // scratch
+    std::vector<glm::vec3> vertexForces; // scratch
+
+    // Optional phase observer, not owned
+    StepObserver* observer = nullptr;
+
+    // Health of the step in progress, published to the snapshot at its end for getHealth()
+    StepHealth health;
+    StepHealth healthSnapshot;
+    mutable std::mutex healthMutex;
+
+    // Optional coupled air grid, not owned
+    WindGrid* windGrid = nullptr;
+    std::vector<glm::vec3> gridVelocities; // scratch
+
+    // Memory budget, 0 for none
+    size_t memoryBudget = 0;
+    bool springsMerged = false;
 
 public:
     RectClothSimulator(
@@ -51,12 +172,113 @@ public:
             const glm::vec3& gravity);
     ~RectClothSimulator() = default;
 
+    // Advance by 'timeStep' simulated seconds; nothing here reads the wall clock
     void step(float timeStep);
+    // The two halves of step(), for ClothScene to resolve contacts between cloths in between:
+    //  solveStep() moves the particles, finishStep() applies drag, tears, hands the positions
+    //  to the cloth and publishes the health
+    void solveStep(float timeStep);
+    void finishStep(float timeStep);
+    float getTime() const { return time; };
+    // Health of the last finished step; safe to poll from another thread
+    StepHealth getHealth() const;
+    void setTime(float value) { time = value; };
+
+    // Read the air velocity from the grid and splat the cloth's reaction back into it
+    void setWindGrid(WindGrid* grid) { windGrid = grid; };
+    void setColliders(ColliderSet* set) { colliders = set; contactCache.invalidate(); };
+    void setTearStrain(float strain) { tearStrain = strain; };
+    void setObserver(StepObserver* stepObserver) { observer = stepObserver; };
+    // Effort of the barrier step: Newton iterations per step, CG iterations per Newton iteration
+    void setSolverIterations(unsigned int newton, unsigned int cg) { maxNewtonIterations = newton; maxCgIterations = cg; };
+
+    // Triangle BVH over the current positions, for picking and narrowphase queries
+    const ClothBvh& getBvh();
+
+    // Spatial queries on the current positions, through the BVH (refit at most once per step)
+    bool raycast(const glm::vec3& origin, const glm::vec3& direction, ClothBvh::RayHit& hit);
+    bool nearestParticle(const glm::vec3& p, unsigned int& idx, float maxDistance = 1e30f);
+    void particlesWithin(const glm::vec3& center, float radius, std::vector<unsigned int>& found);
+
+    // Drag constraint for interactive picking, the grabbed particle is pinned meanwhile; anchored corners ignore it
+    void grab(unsigned int idx, const glm::vec3& target) { dragParticle = (int)idx; dragTarget = target; };
+    void moveGrab(const glm::vec3& target) { dragTarget = target; };
+    void release() { dragParticle = -1; };
+    bool isGrabbing() const { return dragParticle >= 0; };
+    const glm::vec3& getPosition(unsigned int idx) const { return positions[idx]; };
+    const glm::vec3& getVelocity(unsigned int idx) const { return particles[idx].velocity; };
+    unsigned int getSpringCount() const { return (unsigned int)springs.size(); };
+    // Modelled memory traffic and arithmetic of one step's 'phase', for roofline estimates;
+    //  false for the phases whose cost depends on the contacts found (and for wind, with is_aerodynamic)
+    bool estimateTraffic(StepPhase phase, double& bytes, double& flops) const;
+    // Kinetic, spring and gravitational (zero at the origin) energy, for accuracy studies
+    double totalEnergy() const;
+
+    // Memory held by the simulator and its cloth; the colliders and the wind grid are not counted
+    MemoryFootprint memoryFootprint() const;
+    // Optional limit on memoryFootprint().total(), 0 for none, checked when set: past it, every
+    //  pair of opposite springs is merged into one of twice the stiffness (the same forces from
+    //  half the springs). Scratch is sized on the first steps, so set it after one to count that
+    //  too. Returns whether the footprint is within the budget afterwards.
+    bool setMemoryBudget(size_t bytes);
+    size_t getMemoryBudget() const { return memoryBudget; };
+    bool areSpringsMerged() const { return springsMerged; };
+
+    // Contact with other cloths, driven by ClothScene between solveStep() and finishStep() of
+    //  every simulator: begin on all, collideWith for both orders of every overlapping pair,
+    //  then end on all
+    void beginClothContacts();
+    // This cloth's particles against 'other's triangles, kept 'thickness' apart
+    void collideWith(RectClothSimulator& other, float thickness);
+    void endClothContacts();
+
     bool is_wind;
     bool is_collision;
+    bool is_aerodynamic = false;
+    bool is_self_collision = false;
+    bool is_ccd = false;
+    bool is_triangle_contact = false;
+    // Implicit step with log-barrier contact, instead of the explicit step and its
+    //  collision passes: colliders (with is_collision) and self contact (with
+    //  is_self_collision) never interpenetrate, at a higher cost per step
+    bool is_barrier = false;
+    // Springs break past the strain threshold, taking the triangles along them
+    bool is_tearing = false;
 
 private:
     void createMassParticles(float totalMass);
     void createSprings(float stiffnessReference);
+    void mergeSpringPairs();
     void updateCloth();
+    void applyWind();
+    void applyDrag(float timeStep);
+    void tearSprings();
+    void removeSpring(unsigned int idx);
+    void releaseTriangle(unsigned int triangle);
+    void applyAerodynamics(float timeStep);
+    void resolveSelfCollisions();
+    void applyContactVelocities();
+    void resolveTriangleContacts();
+    void resolveContinuousCollisions();
+    void resolveContinuousSelfCollisions(float timeStep);
+    void applyImpulse(const unsigned int* vertices, const float* weights, glm::vec3 normal, float remaining);
+    unsigned int findEdge(const glm::uvec2& edge) const;
+    void compactEdges();
+    // Earliest impacts of the motion from -> to, into vertexImpactTimes / edgeImpactTimes (2 if none)
+    void findSelfImpacts(const std::vector<glm::vec3>& from, const std::vector<glm::vec3>& to, float thickness);
+
+    void stepBarrier(float timeStep);
+    // Total incremental potential at 'x'; also gathers barrierContacts there
+    double barrierEnergy(const std::vector<glm::vec3>& x, float timeStep);
+    void gatherBarrierContacts(const std::vector<glm::vec3>& x);
+    void computeNewtonSystem(float timeStep);
+    void multiplyHessian(const std::vector<glm::vec3>& v, std::vector<glm::vec3>& out, float timeStep);
+    // Returns the CG iterations taken
+    unsigned int solveNewtonDirection(float timeStep);
+    // Largest fraction of the Newton step that is free of intersections, 'longest' is its longest move
+    float barrierStepBound(float longest);
+    void applyBarrierFriction(float timeStep);
+    // Corners hang the cloth when there is nothing to catch it; a grabbed particle is moved by the drag alone
+    bool isAnchored(unsigned int idx) const { return !is_collision && (idx == 0u || idx == cloth->nw - 1); };
+    bool isPinned(unsigned int idx) const { return isAnchored(idx) || (int)idx == dragParticle; };
 };
\ No newline at end of file
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "aabb.hpp"
+#include "cloth_bvh.hpp"
+#include "contact_cache.hpp"
+#include "signed_distance_field.hpp"
+
+enum class ColliderType {
+    Sphere,
+    Plane,
+    Capsule,
+    Box,
+    Heightfield,
+    Sdf
+};
+
+struct Collider {
+    ColliderType type;
+
+    // Sphere: center, radius
+    // Plane: center is a point on the plane, axis its normal
+    // Capsule: center and axis are the two segment ends, radius
+    // Box: center, rotation (columns are the box axes), halfExtents
+    // Heightfield: center is the corner of sample (0, 0), spacing and heights on the x-z grid
+    // Sdf: field placed at center with rotation, radius is an extra skin thickness
+    glm::vec3 center = glm::vec3(0.0f);
+    glm::vec3 axis = glm::vec3(0.0f, 1.0f, 0.0f);
+    float radius = 0.0f;
+    glm::mat3 rotation = glm::mat3(1.0f);
+    glm::vec3 halfExtents = glm::vec3(0.0f);
+    float spacing = 1.0f;
+    unsigned int nx = 0;
+    unsigned int nz = 0;
+    std::vector<float> heights;
+    float maxSlope = 0.0f; // Heightfield: steepest gradient of the surface, kept up to date by ColliderSet
+    const SignedDistanceField* field = nullptr; // not owned
+    float friction = 0.3f; // Coulomb coefficient against the cloth
+
+    // Kinematic motion, applied by ColliderSet::advance. The rotation also tracks the
+    //  orientation of shapes that do not use it, relative to how they were added.
+    glm::vec3 velocity = glm::vec3(0.0f);
+    glm::vec3 angularVelocity = glm::vec3(0.0f); // about pivot(), radians per second
+
+    Aabb bounds() const;
+
+    // Point the collider turns about: the capsule's midpoint, otherwise 'center'
+    glm::vec3 pivot() const { return type == ColliderType::Capsule ? 0.5f * (center + axis) : center; };
+    glm::vec3 velocityAt(const glm::vec3& p) const { return velocity + glm::cross(angularVelocity, p - pivot()); };
+    // Move by the velocities over 'timeStep'; heightfields only translate
+    void advance(float timeStep);
+
+    // Signed distance to the surface (negative inside) and the outward normal. A heightfield's
+    //  solid is what lies below the surface within its footprint; outside it the distance is a
+    //  lower bound, the height gap over the steepest slope or the distance to the footprint.
+    float distance(const glm::vec3& p, glm::vec3& normal) const;
+
+    // distance() of 'count' points at once, given and returned as coordinate arrays
+    void distances(const float* x, const float* y, const float* z, int count,
+                   float* out, float* normalX, float* normalY, float* normalZ) const;
+
+    // First time of impact of the motion p0 -> p1 with the surface, as a fraction of the step.
+    //  Motions that start inside are left to resolve(). A motion that is still closing in when
+    //  the search gives up is reported as a hit at the last time known to be clear.
+    bool sweep(const glm::vec3& p0, const glm::vec3& p1, float& toi, glm::vec3& normal) const;
+
+    // Deepest point of triangle (a, b, c) inside the collider, as barycentric coordinates, with
+    //  its signed distance and the normal to push it along. False if the triangle is clear.
+    //  Planes are skipped, a triangle can only reach into them with a vertex.
+    bool triangleContact(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c,
+                         glm::vec3& barycentric, float& depth, glm::vec3& normal) const;
+
+    // Heightfield: largest gradient over its cells, for maxSlope
+    float steepestSlope() const;
+
+private:
+    float heightAt(float x, float z) const;
+};
+
+// A list of colliders with a tile broadphase against the cloth
+class ColliderSet {
+private:
+    std::vector<Collider> colliders;
+    std::vector<Aabb> colliderBounds; // refreshed at the start of every resolve
+    // Totals since construction; a ContactCache keeps the values it last saw, so that caches
+    //  resolved at different times each get the motion since their own last resolve
+    std::vector<double> colliderTravel; // how far each collider's surface moved through advance()
+    std::vector<double> boundsTravel; // colliderTravel when colliderBounds was refreshed
+    double clock = 0.0; // time advanced
+    unsigned int edits = 0u; // colliders added or changed other than through advance()
+    std::vector<unsigned int> candidates; // scratch, triangles near a collider
+    std::vector<unsigned int> candidateColliders; // scratch
+    std::vector<unsigned int> queries; // scratch, particles due for the narrowphase, in order
+    std::vector<float> queryPoints; // scratch, runs of the x, y and z coordinates of the queries
+    std::vector<float> queryDistances; // scratch, per collider a run of one per query
+    std::vector<float> queryNormals; // scratch, per collider runs of the x, y and z coordinates
+
+public:
+    ColliderSet() = default;
+    ~ColliderSet() = default;
+
+    unsigned int addSphere(const glm::vec3& center, float radius);
+    unsigned int addPlane(const glm::vec3& point, const glm::vec3& normal);
+    unsigned int addCapsule(const glm::vec3& a, const glm::vec3& b, float radius);
+    unsigned int addBox(const glm::vec3& center, const glm::vec3& halfExtents, const glm::mat3& rotation = glm::mat3(1.0f));
+    unsigned int addHeightfield(const glm::vec3& corner, float spacing, unsigned int nx, unsigned int nz,
+                                const std::vector<float>& heights);
+    unsigned int addSdf(const SignedDistanceField* field, const glm::vec3& center = glm::vec3(0.0f),
+                        const glm::mat3& rotation = glm::mat3(1.0f), float thickness = 0.0f);
+
+    unsigned int size() const { return (unsigned int)colliders.size(); };
+    Collider& get(unsigned int idx) { return colliders[idx]; };
+    const Collider& get(unsigned int idx) const { return colliders[idx]; };
+
+    // Kinematic animation: set the velocities so that collider 'idx' has its pivot at 'pivot' and
+    //  orientation 'rotation' after 'frameTime' worth of advance() calls. Called once per frame,
+    //  this interpolates the pose linearly across the frame's simulation steps.
+    void moveTo(unsigned int idx, const glm::vec3& pivot, const glm::mat3& rotation, float frameTime);
+    // Move every collider over one simulation step, before the cloth steps are resolved
+    void advance(float timeStep);
+
+    // Resolve penetrations of the given points, which are processed in contiguous tiles of
+    //  'tileSize' (e.g. a few cloth rows), with contacts carried across calls in 'cache': a
+    //  particle is only queried again once it moved further than the cache allows, and touching
+    //  contacts apply friction warm started from the previous step. The queried particles go
+    //  through Collider::distances in chunks of 'tileSize', against the colliders near each
+    //  chunk. Returns the number of touching contacts.
+    //  Collider motion from advance() since the cache's last resolve shrinks what it allows;
+    //  other edits to a collider that change its bounds reset every cache.
+    unsigned int resolve(std::vector<glm::vec3>& positions, ContactCache& cache, unsigned int tileSize);
+
+    // Continuous version: the motion of every point from 'previous' to 'positions' is swept
+    //  against the colliders its tile's swept box touches. A point that hits is stopped on
+    //  the surface, keeps the tangential part of its remaining motion, and gets the contact
+    //  normal in 'hitNormals' (zero otherwise). Returns the number of hits.
+    unsigned int sweep(const std::vector<glm::vec3>& previous, std::vector<glm::vec3>& positions,
+                       std::vector<glm::vec3>& hitNormals, unsigned int tileSize);
+
+    // Triangle pass after resolve(), so that colliders smaller than the particle spacing cannot
+    //  slip between particles. Triangles come from the BVH (refit to 'positions'), and each
+    //  contact moves the triangle's vertices by barycentric weight; a vertex in several contacts
+    //  gets their average. The applied per-vertex corrections are left in 'corrections'.
+    //  Returns the number of triangle contacts.
+    unsigned int resolveTriangles(std::vector<glm::vec3>& positions, const std::vector<glm::uvec3>& triangles,
+                                  const ClothBvh& bvh, std::vector<glm::vec4>& corrections);
+
+private:
+    unsigned int add(const Collider& collider);
+    void updateBounds();
+};
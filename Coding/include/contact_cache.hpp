@@ -0,0 +1,69 @@
+#pragma once
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "memory_footprint.hpp"
+
+// Contact between one particle and one collider, kept across steps
+struct Contact {
+    unsigned int particle;
+    unsigned int collider;
+    glm::vec3 normal; // surface normal at the last narrowphase
+    glm::vec3 surface; // closest surface point at the last narrowphase
+    glm::vec3 anchor; // where the particle was left last step, for static friction
+    float lambda = 0.0f; // push-out of the last step, warm starts the friction bound
+    bool touching = false; // pushed out this step
+    bool sticking = false; // held by static friction this step
+};
+
+// Contact state carried between ColliderSet::resolve calls.
+// Every particle remembers where its narrowphase last ran and how far it may move from
+// there before the result can change: the margin while it has contacts (whose surfaces
+// are treated as their tangent planes meanwhile), otherwise its clearance from the
+// colliders. Inside that radius the cached contacts are reused without any query.
+// The cache also remembers how far the set had advanced when it was last resolved, so
+// that several caches (e.g. one per cloth) can share a set.
+class ContactCache {
+public:
+    float margin;
+
+    // Contacts grouped by particle, those of particle i are [offsets[i], offsets[i + 1])
+    std::vector<Contact> contacts;
+    std::vector<unsigned int> offsets;
+    std::vector<glm::vec3> references; // position at the last narrowphase
+    std::vector<float> radii; // negative when the particle must be queried
+
+    // Where the collider set was at the last resolve, empty before the first
+    std::vector<double> travelSeen; // travel of every collider
+    double clockSeen = 0.0;
+    unsigned int editsSeen = 0u;
+
+    // Scratch for the rebuild, one list per tile
+    std::vector<std::vector<Contact>> tileContacts;
+
+    ContactCache(float margin = 0.01f) : margin(margin) {};
+    ~ContactCache() = default;
+
+    // Start over, e.g. after switching to another collider set
+    void invalidate() {
+        radii.assign(radii.size(), -1.0f);
+        travelSeen.clear();
+    };
+
+    void resize(unsigned int count) {
+        if (radii.size() != count) {
+            contacts.clear();
+            offsets.assign(count + 1, 0u);
+            references.assign(count, glm::vec3(0.0f));
+            radii.assign(count, -1.0f);
+        }
+    };
+
+    unsigned int size() const { return (unsigned int)contacts.size(); };
+    size_t memoryBytes() const {
+        return vectorBytes(contacts) + vectorBytes(offsets) + vectorBytes(references) + vectorBytes(radii) + vectorBytes(travelSeen)
+            + vectorBytes(tileContacts);
+    };
+};
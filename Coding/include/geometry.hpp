@@ -0,0 +1,57 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+// Closest point on triangle (a, b, c) to p, with its barycentric coordinates
+inline glm::vec3 closestPointOnTriangle(
+    const glm::vec3& p,
+    const glm::vec3& a,
+    const glm::vec3& b,
+    const glm::vec3& c,
+    glm::vec3& barycentric
+) {
+    glm::vec3 ab = b - a, ac = c - a, ap = p - a;
+    float d1 = glm::dot(ab, ap), d2 = glm::dot(ac, ap);
+    if (d1 <= 0.0f && d2 <= 0.0f) { barycentric = glm::vec3(1.0f, 0.0f, 0.0f); return a; }
+
+    glm::vec3 bp = p - b;
+    float d3 = glm::dot(ab, bp), d4 = glm::dot(ac, bp);
+    if (d3 >= 0.0f && d4 <= d3) { barycentric = glm::vec3(0.0f, 1.0f, 0.0f); return b; }
+
+    float vc = d1 * d4 - d3 * d2;
+    if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) {
+        float v = d1 / (d1 - d3);
+        barycentric = glm::vec3(1.0f - v, v, 0.0f);
+        return a + v * ab;
+    }
+
+    glm::vec3 cp = p - c;
+    float d5 = glm::dot(ab, cp), d6 = glm::dot(ac, cp);
+    if (d6 >= 0.0f && d5 <= d6) { barycentric = glm::vec3(0.0f, 0.0f, 1.0f); return c; }
+
+    float vb = d5 * d2 - d1 * d6;
+    if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) {
+        float w = d2 / (d2 - d6);
+        barycentric = glm::vec3(1.0f - w, 0.0f, w);
+        return a + w * ac;
+    }
+
+    float va = d3 * d6 - d5 * d4;
+    if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f) {
+        float w = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+        barycentric = glm::vec3(0.0f, 1.0f - w, w);
+        return b + w * (c - b);
+    }
+
+    float denom = 1.0f / (va + vb + vc);
+    float v = vb * denom, w = vc * denom;
+    barycentric = glm::vec3(1.0f - v - w, v, w);
+    return a + ab * v + ac * w;
+}
+
+// Closest point on segment (a, b) to p, t is the segment parameter
+inline glm::vec3 closestPointOnSegment(const glm::vec3& p, const glm::vec3& a, const glm::vec3& b, float& t) {
+    glm::vec3 ab = b - a;
+    t = glm::clamp(glm::dot(p - a, ab) / glm::max(glm::dot(ab, ab), 1e-12f), 0.0f, 1.0f);
+    return a + t * ab;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+// Memory a cloth holds, in bytes, by what it is for. Buffers count at their capacity, which is
+//  what stays resident, not at the size in use.
+struct MemoryFootprint {
+    size_t particles = 0; // particle state: positions, velocities, forces, masses
+    size_t topology = 0; // springs and their adjacency, triangles, edges, hierarchies
+    size_t scratch = 0; // per-step buffers and tables of the solver, collision and wind passes
+    size_t vertices = 0; // CPU copies of the vertices: the cloth's positions and the draw mesh
+    size_t gpu = 0; // vertex and index buffers
+
+    size_t total() const { return particles + topology + scratch + vertices + gpu; };
+
+    MemoryFootprint& operator+=(const MemoryFootprint& other) {
+        particles += other.particles;
+        topology += other.topology;
+        scratch += other.scratch;
+        vertices += other.vertices;
+        gpu += other.gpu;
+        return *this;
+    };
+};
+
+template <typename T>
+inline size_t vectorBytes(const std::vector<T>& buffer) {
+    return sizeof(T) * buffer.capacity();
+}
+
+// Lists of lists: the outer array and every inner one
+template <typename T>
+inline size_t vectorBytes(const std::vector<std::vector<T>>& buffers) {
+    size_t bytes = sizeof(std::vector<T>) * buffers.capacity();
+    for (const std::vector<T>& buffer : buffers) {
+        bytes += vectorBytes(buffer);
+    }
+    return bytes;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+enum class PerfEvent {
+    Cycles,
+    Instructions,
+    CacheMisses, // last level cache
+    BranchMisses,
+    Count
+};
+
+inline const char* perfEventName(PerfEvent event) {
+    switch (event) {
+        case PerfEvent::Cycles: return "cycles";
+        case PerfEvent::Instructions: return "instructions";
+        case PerfEvent::CacheMisses: return "llc_misses";
+        case PerfEvent::BranchMisses: return "branch_misses";
+        default: return "unknown";
+    }
+}
+
+// Hardware counters of the calling thread (user space only), through perf_event_open on Linux.
+// With 'inheritThreads', they also count every thread it creates afterwards, so constructed
+//  before the first OpenMP parallel region they cover the whole thread pool.
+// Each counter that cannot be opened (no PMU in a VM, perf_event_paranoid, other systems) is
+//  just unavailable, and reads as zero.
+class PerfCounters {
+private:
+    int fds[(int)PerfEvent::Count];
+    std::string problem;
+
+public:
+    explicit PerfCounters(bool inheritThreads = false);
+    ~PerfCounters();
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    bool isAvailable(PerfEvent event) const { return fds[(int)event] >= 0; };
+    bool isAnyAvailable() const;
+    // Why the first unavailable counter could not be opened, empty if all are there
+    const std::string& getProblem() const { return problem; };
+
+    // Counts since construction, scaled up if the kernel multiplexed the counters
+    void read(uint64_t values[(int)PerfEvent::Count]) const;
+};
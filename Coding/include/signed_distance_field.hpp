@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "aabb.hpp"
+
+// A narrow-band signed distance field on a sparse brick grid.
+// Only 8x8x8 bricks that contain the band are stored (as 16-bit distances); the
+// others are flagged as uniformly inside or outside. The on-disk layout is the
+// in-memory layout, so a saved field is memory mapped on load.
+class SignedDistanceField {
+public:
+    static constexpr unsigned int brickSize = 8;
+    static constexpr unsigned int brickVolume = brickSize * brickSize * brickSize;
+    static constexpr int32_t outsideBrick = -1;
+    static constexpr int32_t insideBrick = -2;
+
+private:
+    struct FileHeader {
+        char magic[4];
+        uint32_t version;
+        uint32_t bricks[3];
+        uint32_t brickCount;
+        float origin[3];
+        float voxelSize;
+        float band;
+        uint32_t reserved;
+    };
+
+    glm::uvec3 bricks = glm::uvec3(0);
+    glm::vec3 origin = glm::vec3(0.0f);
+    float voxelSize = 1.0f;
+    float band = 0.0f;
+
+    // Either point into the owned vectors or into the mapped file
+    const int32_t* table = nullptr;
+    const int16_t* data = nullptr;
+    std::vector<int32_t> ownedTable;
+    std::vector<int16_t> ownedData;
+    void* mapping = nullptr;
+    std::size_t mappingSize = 0;
+
+public:
+    SignedDistanceField() = default;
+    ~SignedDistanceField();
+    SignedDistanceField(const SignedDistanceField&) = delete;
+    SignedDistanceField& operator=(const SignedDistanceField&) = delete;
+
+    // Build from a closed triangle mesh; the band is 'bandVoxels' (at least 1) voxels on each
+    //  side of the surface. Invalid input leaves the field empty.
+    void build(
+        const std::vector<glm::vec3>& vertices,
+        const std::vector<glm::uvec3>& triangles,
+        float voxelSize,
+        unsigned int bandVoxels = 3);
+
+    bool save(const std::string& path) const;
+    bool load(const std::string& path);
+
+    bool isEmpty() const { return table == nullptr; };
+    Aabb bounds() const;
+
+    // Trilinear distance and its gradient, in the field's local frame
+    float sample(const glm::vec3& p, glm::vec3& gradient) const;
+
+private:
+    float nodeValue(unsigned int x, unsigned int y, unsigned int z) const;
+    void release();
+};
+
+// Minimal Wavefront OBJ reader (positions and faces, polygons are fanned); fails on a face
+//  index that does not name a vertex read before it
+bool loadObjMesh(const std::string& path, std::vector<glm::vec3>& vertices, std::vector<glm::uvec3>& triangles);
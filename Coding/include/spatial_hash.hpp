@@ -0,0 +1,57 @@
+#pragma once
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "memory_footprint.hpp"
+
+// A uniform-grid spatial hash over points, rebuilt every step with a parallel counting sort.
+// After build(), the points of each hash bucket are contiguous in 'sortedIndices'.
+class SpatialHash {
+private:
+    float cellSize;
+    unsigned int tableMask = 0;
+
+    std::vector<unsigned int> keys; // bucket of every point
+    std::vector<unsigned int> cellStart; // bucket b owns sortedIndices[cellStart[b], cellStart[b + 1])
+    std::vector<unsigned int> cellCursor; // scratch for the scatter
+    std::vector<unsigned int> sortedIndices;
+    std::vector<unsigned int> blockSums; // scratch for the parallel prefix sum
+
+public:
+    SpatialHash(float cellSize = 1.0f);
+    ~SpatialHash() = default;
+
+    void setCellSize(float value) { cellSize = value; };
+    float getCellSize() const { return cellSize; };
+    size_t memoryBytes() const {
+        return vectorBytes(keys) + vectorBytes(cellStart) + vectorBytes(cellCursor) + vectorBytes(sortedIndices) + vectorBytes(blockSums);
+    };
+
+    void build(const std::vector<glm::vec3>& positions);
+
+    // Call 'visit(index)' for every point whose cell overlaps the box [p - radius, p + radius].
+    //  Hash collisions can report far away points, callers check the distance themselves.
+    template <typename Visitor>
+    void query(const glm::vec3& p, float radius, Visitor&& visit) const {
+        glm::ivec3 lo = cellOf(p - radius);
+        glm::ivec3 hi = cellOf(p + radius);
+        for (int z = lo.z; z <= hi.z; z++) {
+            for (int y = lo.y; y <= hi.y; y++) {
+                for (int x = lo.x; x <= hi.x; x++) {
+                    unsigned int bucket = hash(x, y, z);
+                    for (unsigned int k = cellStart[bucket]; k < cellStart[bucket + 1]; k++) {
+                        visit(sortedIndices[k]);
+                    }
+                }
+            }
+        }
+    };
+
+private:
+    glm::ivec3 cellOf(const glm::vec3& p) const { return glm::ivec3(glm::floor(p / cellSize)); };
+    unsigned int hash(int x, int y, int z) const {
+        return ((unsigned int)x * 73856093u ^ (unsigned int)y * 19349663u ^ (unsigned int)z * 83492791u) & tableMask;
+    };
+};
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "trace.hpp"
+
+// Phases of RectClothSimulator::step, in the order they run
+enum class StepPhase {
+    Integrate,
+    Springs,
+    Wind,
+    Collision,
+    SelfCollision,
+    Barrier,
+    Tearing,
+    Update,
+    Aerodynamics,
+    Count
+};
+
+inline const char* stepPhaseName(StepPhase phase) {
+    switch (phase) {
+        case StepPhase::Integrate: return "integrate";
+        case StepPhase::Springs: return "springs";
+        case StepPhase::Wind: return "wind";
+        case StepPhase::Collision: return "collision";
+        case StepPhase::SelfCollision: return "self_collision";
+        case StepPhase::Barrier: return "barrier";
+        case StepPhase::Tearing: return "tearing";
+        case StepPhase::Update: return "update";
+        case StepPhase::Aerodynamics: return "aerodynamics";
+        default: return "unknown";
+    }
+}
+
+// Told when each phase of a step begins and ends, e.g. to time them.
+// Phases that a step skips are not reported.
+class StepObserver {
+public:
+    virtual ~StepObserver() = default;
+    virtual void phaseBegin(StepPhase phase) = 0;
+    virtual void phaseEnd(StepPhase phase) = 0;
+};
+
+// Reports its phase to the observer, if there is one, for the lifetime of the scope;
+//  traced builds also record it (see trace.hpp)
+class PhaseScope {
+private:
+    StepObserver* observer;
+    StepPhase phase;
+#ifdef CLOTH_TRACE
+    uint64_t begin = traceNow();
+#endif
+
+public:
+    PhaseScope(StepObserver* observer, StepPhase phase) : observer(observer), phase(phase) {
+        if (observer) {
+            observer->phaseBegin(phase);
+        }
+    };
+    ~PhaseScope() {
+        if (observer) {
+            observer->phaseEnd(phase);
+        }
+#ifdef CLOTH_TRACE
+        traceRecord(stepPhaseName(phase), begin, traceNow());
+#endif
+    };
+    PhaseScope(const PhaseScope&) = delete;
+    PhaseScope& operator=(const PhaseScope&) = delete;
+};
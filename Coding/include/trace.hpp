@@ -0,0 +1,42 @@
+#pragma once
+
+// Scoped timers for finding where a frame goes, exported as Chrome trace_event JSON
+//  (chrome://tracing or ui.perfetto.dev). Build with -DCLOTH_TRACE=ON to record; otherwise
+//  CLOTH_TRACE_SCOPE compiles to nothing and traceDump() does nothing.
+// Every thread records into its own ring buffer without locking, so only the newest events
+//  of each thread are kept. With CLOTH_TRACE_FILE set in the environment, the trace is also
+//  written there at exit.
+
+#ifdef CLOTH_TRACE
+
+#include <cstdint>
+
+// Nanoseconds since the first trace call of the process
+uint64_t traceNow();
+// A finished scope, on the calling thread; 'name' must outlive the trace (e.g. a literal)
+void traceRecord(const char* name, uint64_t begin, uint64_t end);
+// Write every thread's buffered events, best called between frames; false if the file cannot be written
+bool traceDump(const char* path);
+
+class TraceScope {
+private:
+    const char* name;
+    uint64_t begin;
+
+public:
+    explicit TraceScope(const char* name) : name(name), begin(traceNow()) {};
+    ~TraceScope() { traceRecord(name, begin, traceNow()); };
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+};
+
+#define CLOTH_TRACE_JOIN_(a, b) a##b
+#define CLOTH_TRACE_JOIN(a, b) CLOTH_TRACE_JOIN_(a, b)
+#define CLOTH_TRACE_SCOPE(name) TraceScope CLOTH_TRACE_JOIN(traceScope, __LINE__)(name)
+
+#else
+
+#define CLOTH_TRACE_SCOPE(name) ((void)0)
+inline bool traceDump(const char*) { return false; }
+
+#endif
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "memory_footprint.hpp"
+
+// A tileable curl-noise turbulence volume.
+// The volume is built once; at runtime it is scrolled by the simulated time and
+// evaluated by trilinear lookup, so a sample costs no transcendental functions.
+class WindField {
+private:
+    unsigned int resolution; // cells per axis, a power of two
+    unsigned int mask;
+    float cellSize;
+    float strength;
+    glm::vec3 scrollVelocity;
+
+    // One channel per component
+    std::vector<float> vx;
+    std::vector<float> vy;
+    std::vector<float> vz;
+
+    glm::vec3 offset; // scroll offset for the current time, in cells
+
+public:
+    WindField(
+        unsigned int resolution = 32,
+        float cellSize = 0.25f,
+        float strength = 1.0f,
+        const glm::vec3& scrollVelocity = glm::vec3(0.8f, 0.1f, 0.4f),
+        unsigned int seed = 1u);
+    ~WindField() = default;
+
+    // Sample the time once per step, before any lookups
+    void setTime(float time);
+
+    glm::vec3 sample(const glm::vec3& position) const;
+    void sample(const std::vector<glm::vec3>& positions, std::vector<glm::vec3>& out) const;
+
+    size_t memoryBytes() const { return vectorBytes(vx) + vectorBytes(vy) + vectorBytes(vz); };
+
+private:
+    void buildVolume(unsigned int seed);
+
+    unsigned int idxFromCell(unsigned int x, unsigned int y, unsigned int z) const {
+        return ((z & mask) * resolution + (y & mask)) * resolution + (x & mask);
+    };
+};
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// A coarse stable-fluids velocity grid for two-way cloth/air coupling.
+// Cloths read the air velocity from it and splat their reaction momentum back;
+// the grid is advanced once per frame, independently of the cloth resolution.
+class WindGrid {
+private:
+    glm::uvec3 size;
+    glm::vec3 origin; // corner of cell (0, 0, 0)
+    float cellSize;
+    glm::vec3 ambientVelocity; // far field, held on the boundary cells
+
+    std::vector<glm::vec3> velocity;
+    std::vector<glm::vec3> advected; // scratch
+    std::vector<glm::vec3> momentum; // splatted since the last step
+    std::vector<float> pressure;
+    std::vector<float> pressureNext; // scratch
+    std::vector<float> divergence; // scratch
+
+public:
+    float airDensity = 1.2f;
+    unsigned int pressureIterations = 20;
+
+    WindGrid(
+        const glm::uvec3& size,
+        const glm::vec3& origin,
+        float cellSize,
+        const glm::vec3& ambientVelocity = glm::vec3(0.0f));
+    ~WindGrid() = default;
+
+    // Apply the splatted momentum, advect and project
+    void step(float timeStep);
+
+    glm::vec3 sample(const glm::vec3& position) const;
+    void sample(const std::vector<glm::vec3>& positions, std::vector<glm::vec3>& out) const;
+
+    // Deposit momentum (force times time) into the cells around each position
+    void splat(const std::vector<glm::vec3>& positions, const std::vector<glm::vec3>& momenta);
+
+    void setAmbientVelocity(const glm::vec3& value) { ambientVelocity = value; };
+
+private:
+    void applyMomentum();
+    void advect(float timeStep);
+    void project();
+    void applyBoundary();
+
+    glm::vec3 sampleField(const std::vector<glm::vec3>& field, const glm::vec3& position) const;
+
+    unsigned int idxFromCell(unsigned int x, unsigned int y, unsigned int z) const {
+        return (z * size.y + y) * size.x + x;
+    };
+    bool isBoundary(unsigned int x, unsigned int y, unsigned int z) const {
+        return x == 0 || y == 0 || z == 0 || x == size.x - 1 || y == size.y - 1 || z == size.z - 1;
+    };
+};
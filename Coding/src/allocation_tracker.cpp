@@ -0,0 +1,188 @@
+#include "allocation_tracker.hpp"
+
+#include <cstdio>
+
+#ifdef CLOTH_TRACK_ALLOCATIONS
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <new>
+
+namespace {
+
+std::atomic<uint64_t> allocationCount{0};
+std::atomic<uint64_t> allocatedBytes{0};
+std::atomic<uint64_t> liveBytes{0};
+std::atomic<uint64_t> peakBytes{0};
+std::atomic<uint64_t> expectedCount{0};
+
+// Every block carries its size in front, padded to keep the default new alignment
+constexpr size_t header = __STDCPP_DEFAULT_NEW_ALIGNMENT__;
+
+void countAllocation(size_t size) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+    uint64_t live = liveBytes.fetch_add(size, std::memory_order_relaxed) + size;
+    uint64_t peak = peakBytes.load(std::memory_order_relaxed);
+    while (live > peak && !peakBytes.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {
+    }
+}
+
+void* allocate(size_t size, size_t alignment) {
+    // The block starts 'offset' bytes into the raw allocation, with its size and the raw pointer just before it
+    const size_t offset = alignment > header ? alignment : header;
+    void* raw = alignment > header ? aligned_alloc(alignment, (offset + size + alignment - 1) / alignment * alignment)
+                                   : malloc(offset + size);
+    if (!raw) {
+        return nullptr;
+    }
+    char* block = (char*)raw + offset;
+    memcpy(block - sizeof(size_t), &size, sizeof(size_t));
+    memcpy(block - 2 * sizeof(size_t), &raw, sizeof(void*));
+    countAllocation(size);
+    return block;
+}
+
+void release(void* block) {
+    if (!block) {
+        return;
+    }
+    size_t size;
+    void* raw;
+    memcpy(&size, (char*)block - sizeof(size_t), sizeof(size_t));
+    memcpy(&raw, (char*)block - 2 * sizeof(size_t), sizeof(void*));
+    liveBytes.fetch_sub(size, std::memory_order_relaxed);
+    free(raw);
+}
+
+void* allocateOrThrow(size_t size, size_t alignment) {
+    void* block = allocate(size, alignment);
+    if (!block) {
+        throw std::bad_alloc();
+    }
+    return block;
+}
+
+struct SubsystemTotals {
+    const char* name;
+    uint64_t allocations, bytes, peakBytes;
+};
+std::mutex subsystemMutex;
+SubsystemTotals subsystems[32];
+unsigned int subsystemCount = 0;
+
+}
+
+void* operator new(size_t size) { return allocateOrThrow(size, 0); }
+void* operator new[](size_t size) { return allocateOrThrow(size, 0); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept { return allocate(size, 0); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { return allocate(size, 0); }
+void* operator new(size_t size, std::align_val_t alignment) { return allocateOrThrow(size, (size_t)alignment); }
+void* operator new[](size_t size, std::align_val_t alignment) { return allocateOrThrow(size, (size_t)alignment); }
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept { return allocate(size, (size_t)alignment); }
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept { return allocate(size, (size_t)alignment); }
+void operator delete(void* block) noexcept { release(block); }
+void operator delete[](void* block) noexcept { release(block); }
+void operator delete(void* block, size_t) noexcept { release(block); }
+void operator delete[](void* block, size_t) noexcept { release(block); }
+void operator delete(void* block, const std::nothrow_t&) noexcept { release(block); }
+void operator delete[](void* block, const std::nothrow_t&) noexcept { release(block); }
+void operator delete(void* block, std::align_val_t) noexcept { release(block); }
+void operator delete[](void* block, std::align_val_t) noexcept { release(block); }
+void operator delete(void* block, size_t, std::align_val_t) noexcept { release(block); }
+void operator delete[](void* block, size_t, std::align_val_t) noexcept { release(block); }
+void operator delete(void* block, std::align_val_t, const std::nothrow_t&) noexcept { release(block); }
+void operator delete[](void* block, std::align_val_t, const std::nothrow_t&) noexcept { release(block); }
+
+AllocationStats allocationStats() {
+    AllocationStats stats;
+    stats.allocations = allocationCount.load(std::memory_order_relaxed);
+    stats.bytes = allocatedBytes.load(std::memory_order_relaxed);
+    stats.liveBytes = liveBytes.load(std::memory_order_relaxed);
+    stats.peakBytes = peakBytes.load(std::memory_order_relaxed);
+    return stats;
+}
+
+AllocationScope::
+~AllocationScope() {
+    AllocationStats now = allocationStats();
+    std::lock_guard<std::mutex> lock(subsystemMutex);
+    SubsystemTotals* totals = nullptr;
+    for (unsigned int k = 0; k < subsystemCount && !totals; k++) {
+        totals = strcmp(subsystems[k].name, subsystem) == 0 ? &subsystems[k] : nullptr;
+    }
+    if (!totals && subsystemCount < 32) {
+        totals = &subsystems[subsystemCount++];
+        *totals = {subsystem, 0, 0, 0};
+    }
+    if (totals) {
+        totals->allocations += now.allocations - start.allocations;
+        totals->bytes += now.bytes - start.bytes;
+        // How far the process peak rose above where the scope started
+        uint64_t rise = now.peakBytes > start.liveBytes ? now.peakBytes - start.liveBytes : 0;
+        totals->peakBytes = totals->peakBytes > rise ? totals->peakBytes : rise;
+    }
+}
+
+void printAllocationReport() {
+    std::lock_guard<std::mutex> lock(subsystemMutex);
+    printf("allocations by subsystem:\n");
+    for (unsigned int k = 0; k < subsystemCount; k++) {
+        printf("  %-16s %10llu allocations %12llu bytes, peak %12llu bytes\n", subsystems[k].name,
+               (unsigned long long)subsystems[k].allocations, (unsigned long long)subsystems[k].bytes,
+               (unsigned long long)subsystems[k].peakBytes);
+    }
+    AllocationStats stats = allocationStats();
+    printf("  %-16s %10llu allocations %12llu bytes, peak %12llu bytes, live %llu bytes\n", "process",
+           (unsigned long long)stats.allocations, (unsigned long long)stats.bytes,
+           (unsigned long long)stats.peakBytes, (unsigned long long)stats.liveBytes);
+}
+
+void expectAllocation() {
+    expectedCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+NoAllocationGuard::
+NoAllocationGuard(const char* name, bool armed) : name(name), armed(armed),
+    start(allocationCount.load(std::memory_order_relaxed)), expectedStart(expectedCount.load(std::memory_order_relaxed)) {}
+
+NoAllocationGuard::
+~NoAllocationGuard() {
+    uint64_t count = allocationCount.load(std::memory_order_relaxed) - start;
+    uint64_t expected = expectedCount.load(std::memory_order_relaxed) - expectedStart;
+    count = count > expected ? count - expected : 0;
+    if (armed && count > 0) {
+        fprintf(stderr, "ERROR::ALLOCATION::IN_HOT_PATH %s allocated %llu times\n", name, (unsigned long long)count);
+        abort();
+    }
+}
+
+#else
+
+AllocationStats allocationStats() {
+    return AllocationStats();
+}
+
+AllocationScope::
+~AllocationScope() {}
+
+void printAllocationReport() {
+    printf("allocations: not tracked, configure with -DCLOTH_TRACK_ALLOCATIONS=ON\n");
+}
+
+#endif
+
+AllocationScope::
+AllocationScope(const char* subsystem) : subsystem(subsystem), start(allocationStats()) {}
+
+uint64_t AllocationScope::
+allocations() const {
+    return allocationStats().allocations - start.allocations;
+}
+
+uint64_t AllocationScope::
+bytes() const {
+    return allocationStats().bytes - start.bytes;
+}
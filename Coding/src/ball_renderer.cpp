@@ -1,14 +1,20 @@
 #include "ball_renderer.hpp"
+#include "allocation_tracker.hpp"
+#include "trace.hpp"
 
 #define PI 3.1415926f
 
 BallRenderer::
 BallRenderer(
     Shader* shader,
-    FirstPersonCamera* camera
+    FirstPersonCamera* camera,
+    const ColliderSet* colliders,
+    unsigned int colliderIdx
 ) {
     this->shader = shader;
     this->camera = camera;
+    this->colliders = colliders;
+    this->colliderIdx = colliderIdx;
 
     this->initVertices();
     this->initIndices();
@@ -18,10 +24,16 @@ BallRenderer(
 
 void BallRenderer::
 draw() {
+    CLOTH_TRACE_SCOPE("ball_draw");
+    CLOTH_ASSERT_NO_ALLOCATIONS("BallRenderer::draw", drawRuns, 2);
 
     // Update Data
-    glBindBuffer(GL_ARRAY_BUFFER, glo.VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(VertexData) * this->glo.vertices.size(), this->glo.vertices.data(), GL_STREAM_DRAW);
+    {
+        CLOTH_TRACE_SCOPE("ball_upload");
+        this->updateVertices();
+        glBindBuffer(GL_ARRAY_BUFFER, glo.VBO);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(VertexData) * this->glo.vertices.size(), this->glo.vertices.data(), GL_STREAM_DRAW);
+    }
 
     GLint previous;
     glGetIntegerv(GL_POLYGON_MODE, &previous);
@@ -55,17 +67,29 @@ initVertices() {
             float theta = 2 * PI * i / segments;
             float phi = PI * j / segments;
 
-            float x = radius * sin(phi) * cos(theta);
-            float y = radius * cos(phi);
-            float z = radius * sin(phi) * sin(theta);
+            float x = sin(phi) * cos(theta);
+            float y = cos(phi);
+            float z = sin(phi) * sin(theta);
 
             VertexData v;
-            v.position = glm::vec3(x, y, z) + center;
-            v.normal = glm::normalize(v.position - center);
+            v.position = glm::vec3(x, y, z);
+            v.normal = glm::normalize(v.position);
 
-            this->glo.vertices.push_back(v);
+            this->unitSphere.push_back(v);
         }
     }
+    this->glo.vertices.resize(this->unitSphere.size());
+    this->updateVertices();
+}
+
+void BallRenderer::
+updateVertices() {
+    const Collider& ball = this->colliders->get(this->colliderIdx);
+    const float radius = this->shrink * ball.radius;
+    for (unsigned int i = 0; i < this->unitSphere.size(); ++i) {
+        this->glo.vertices[i].position = ball.center + radius * this->unitSphere[i].position;
+        this->glo.vertices[i].normal = this->unitSphere[i].normal;
+    }
 }
 
 
@@ -0,0 +1,148 @@
+#include "ccd.hpp"
+
+#include <algorithm>
+
+#include "geometry.hpp"
+
+// Roots in [0, 1] of c0 + c1 t + c2 t^2 + c3 t^3, ascending. The interval is split at the
+//  critical points, so each piece is monotone and a sign change brackets exactly one root.
+static int cubicRootsInUnitInterval(float c0, float c1, float c2, float c3, float roots[3]) {
+    auto f = [&](float t) { return ((c3 * t + c2) * t + c1) * t + c0; };
+
+    float breaks[4] = {0.0f, 0.0f, 0.0f, 1.0f};
+    int count = 1;
+    // f'(t) = c1 + 2 c2 t + 3 c3 t^2
+    float a = 3.0f * c3, b = 2.0f * c2, c = c1;
+    if (glm::abs(a) > 1e-12f) {
+        float discriminant = b * b - 4.0f * a * c;
+        if (discriminant >= 0.0f) {
+            float root = glm::sqrt(discriminant);
+            float t0 = (-b - root) / (2.0f * a), t1 = (-b + root) / (2.0f * a);
+            if (t0 > t1) std::swap(t0, t1);
+            if (t0 > 0.0f && t0 < 1.0f) breaks[count++] = t0;
+            if (t1 > 0.0f && t1 < 1.0f) breaks[count++] = t1;
+        }
+    } else if (glm::abs(b) > 1e-12f) {
+        float t0 = -c / b;
+        if (t0 > 0.0f && t0 < 1.0f) breaks[count++] = t0;
+    }
+    breaks[count] = 1.0f;
+
+    int found = 0;
+    for (int k = 0; k < count; k++) {
+        float lo = breaks[k], hi = breaks[k + 1];
+        float flo = f(lo), fhi = f(hi);
+        if (flo == 0.0f) { roots[found++] = lo; continue; }
+        if ((flo < 0.0f) == (fhi < 0.0f)) {
+            // A root exactly on the last break has no piece after it to start, e.g. a contact at t = 1
+            if (fhi == 0.0f && k == count - 1) roots[found++] = hi;
+            continue;
+        }
+        for (int iteration = 0; iteration < 32; iteration++) {
+            float mid = 0.5f * (lo + hi);
+            float fmid = f(mid);
+            if ((fmid < 0.0f) == (flo < 0.0f)) { lo = mid; flo = fmid; } else { hi = mid; }
+        }
+        roots[found++] = hi;
+    }
+    return found;
+}
+
+// Coefficients of (a + t va) . ((b + t vb) x (c + t vc))
+static void coplanarityCubic(
+    const glm::vec3& a, const glm::vec3& b, const glm::vec3& c,
+    const glm::vec3& va, const glm::vec3& vb, const glm::vec3& vc,
+    float coefficients[4]
+) {
+    glm::vec3 bc = glm::cross(b, c);
+    glm::vec3 mixed = glm::cross(b, vc) + glm::cross(vb, c);
+    glm::vec3 vbvc = glm::cross(vb, vc);
+    coefficients[0] = glm::dot(a, bc);
+    coefficients[1] = glm::dot(va, bc) + glm::dot(a, mixed);
+    coefficients[2] = glm::dot(va, mixed) + glm::dot(a, vbvc);
+    coefficients[3] = glm::dot(va, vbvc);
+}
+
+bool vertexTriangleCcd(
+    const glm::vec3& p0, const glm::vec3& a0, const glm::vec3& b0, const glm::vec3& c0,
+    const glm::vec3& p1, const glm::vec3& a1, const glm::vec3& b1, const glm::vec3& c1,
+    float thickness, float& toi
+) {
+    float coefficients[4];
+    coplanarityCubic(p0 - a0, b0 - a0, c0 - a0,
+                     (p1 - p0) - (a1 - a0), (b1 - b0) - (a1 - a0), (c1 - c0) - (a1 - a0), coefficients);
+
+    float roots[3];
+    int count = cubicRootsInUnitInterval(coefficients[0], coefficients[1], coefficients[2], coefficients[3], roots);
+    for (int k = 0; k < count; k++) {
+        float t = roots[k];
+        glm::vec3 p = glm::mix(p0, p1, t);
+        glm::vec3 barycentric;
+        glm::vec3 closest = closestPointOnTriangle(p, glm::mix(a0, a1, t), glm::mix(b0, b1, t), glm::mix(c0, c1, t), barycentric);
+        if (glm::length(p - closest) <= thickness) {
+            toi = t;
+            return true;
+        }
+    }
+    return false;
+}
+
+float segmentSegmentDistance(
+    const glm::vec3& p0, const glm::vec3& p1,
+    const glm::vec3& q0, const glm::vec3& q1,
+    float& s, float& t
+) {
+    glm::vec3 d1 = p1 - p0, d2 = q1 - q0, r = p0 - q0;
+    float a = glm::dot(d1, d1), e = glm::dot(d2, d2), f = glm::dot(d2, r);
+    if (a <= 1e-12f && e <= 1e-12f) {
+        s = t = 0.0f;
+        return glm::length(r);
+    }
+    if (a <= 1e-12f) {
+        s = 0.0f;
+        t = glm::clamp(f / e, 0.0f, 1.0f);
+    } else {
+        float c = glm::dot(d1, r);
+        if (e <= 1e-12f) {
+            t = 0.0f;
+            s = glm::clamp(-c / a, 0.0f, 1.0f);
+        } else {
+            float b = glm::dot(d1, d2);
+            float denom = a * e - b * b;
+            s = denom > 1e-12f ? glm::clamp((b * f - c * e) / denom, 0.0f, 1.0f) : 0.0f;
+            t = (b * s + f) / e;
+            if (t < 0.0f) {
+                t = 0.0f;
+                s = glm::clamp(-c / a, 0.0f, 1.0f);
+            } else if (t > 1.0f) {
+                t = 1.0f;
+                s = glm::clamp((b - c) / a, 0.0f, 1.0f);
+            }
+        }
+    }
+    return glm::length((p0 + d1 * s) - (q0 + d2 * t));
+}
+
+bool edgeEdgeCcd(
+    const glm::vec3& a0, const glm::vec3& b0, const glm::vec3& c0, const glm::vec3& d0,
+    const glm::vec3& a1, const glm::vec3& b1, const glm::vec3& c1, const glm::vec3& d1,
+    float thickness, float& toi
+) {
+    float coefficients[4];
+    coplanarityCubic(b0 - a0, c0 - a0, d0 - a0,
+                     (b1 - b0) - (a1 - a0), (c1 - c0) - (a1 - a0), (d1 - d0) - (a1 - a0), coefficients);
+
+    float roots[3];
+    int count = cubicRootsInUnitInterval(coefficients[0], coefficients[1], coefficients[2], coefficients[3], roots);
+    for (int k = 0; k < count; k++) {
+        float t = roots[k];
+        float s, u;
+        float distance = segmentSegmentDistance(glm::mix(a0, a1, t), glm::mix(b0, b1, t),
+                                                glm::mix(c0, c1, t), glm::mix(d0, d1, t), s, u);
+        if (distance <= thickness) {
+            toi = t;
+            return true;
+        }
+    }
+    return false;
+}
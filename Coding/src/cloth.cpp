@@ -13,9 +13,130 @@ RectCloth(
             positions.push_back(getInitialPosition(iw, ih));
         }
     }
+
+    initTriangles();
 }
 
 glm::vec3 RectCloth::
 getInitialPosition(unsigned int iw, unsigned int ih) {
     return transform * glm::vec4((float)iw * dx - width / 2.0f, (float)ih * dx - height / 2.0f, 0.0f, 1.0f);
 }
+
+void RectCloth::
+initTriangles() {
+    triangles.clear();
+    triangles.reserve((nh - 1) * (nw - 1) * 2);
+    for (unsigned int ih = 0; ih < nh - 1; ++ih) {
+        for (unsigned int iw = 0; iw < nw - 1; ++iw) {
+            unsigned int leftDownIdx = idxFromCoord(iw, ih);
+            unsigned int rightDownIdx = idxFromCoord(iw + 1, ih);
+            unsigned int leftUpIdx = idxFromCoord(iw, ih + 1);
+            unsigned int rightUpIdx = idxFromCoord(iw + 1, ih + 1);
+
+            triangles.push_back(glm::uvec3(leftDownIdx, rightDownIdx, rightUpIdx));
+            triangles.push_back(glm::uvec3(leftDownIdx, rightUpIdx, leftUpIdx));
+        }
+    }
+    faceNormals.resize(triangles.size());
+    faceNormalsValid = false;
+    torn.assign(triangles.size(), 0);
+    tornTriangles.clear();
+    tornTriangles.reserve(triangles.size()); // tearing never allocates
+}
+
+const std::vector<glm::vec3>& RectCloth::
+getFaceNormals() {
+    if (faceNormalsValid) {
+        return faceNormals;
+    }
+
+    const int count = (int)triangles.size();
+    const glm::uvec3* tris = triangles.data();
+    const glm::vec3* p = positions.data();
+    const unsigned char* gone = torn.data();
+    glm::vec3* normals = faceNormals.data();
+
+    #pragma omp simd
+    for (int t = 0; t < count; t++) {
+        glm::uvec3 tri = tris[t];
+        normals[t] = gone[t] ? glm::vec3(0.0f) : glm::cross(p[tri.y] - p[tri.x], p[tri.z] - p[tri.x]);
+    }
+
+    faceNormalsValid = true;
+    return faceNormals;
+}
+
+unsigned int RectCloth::
+findEdgeTriangles(unsigned int a, unsigned int b, unsigned int found[2]) const {
+    // Only the triangles of the (up to four) quads around 'a' can have the edge
+    const unsigned int iw = a % nw, ih = a / nw;
+    const unsigned int nq = nw - 1;
+    unsigned int count = 0;
+    for (unsigned int qh = ih > 0 ? ih - 1 : 0; qh <= ih && qh < nh - 1; qh++) {
+        for (unsigned int qw = iw > 0 ? iw - 1 : 0; qw <= iw && qw < nw - 1; qw++) {
+            for (unsigned int t = 2 * (qh * nq + qw); t < 2 * (qh * nq + qw) + 2; t++) {
+                const glm::uvec3 tri = triangles[t];
+                bool hasA = tri.x == a || tri.y == a || tri.z == a;
+                bool hasB = tri.x == b || tri.y == b || tri.z == b;
+                if (hasA && hasB) {
+                    found[count++] = t;
+                }
+            }
+        }
+    }
+    return count;
+}
+
+unsigned int RectCloth::
+tearEdge(unsigned int a, unsigned int b, unsigned int removed[2]) {
+    unsigned int found[2];
+    unsigned int count = 0;
+    for (unsigned int k = 0, n = findEdgeTriangles(a, b, found); k < n; k++) {
+        if (!torn[found[k]]) {
+            torn[found[k]] = 1;
+            tornTriangles.push_back(found[k]);
+            removed[count++] = found[k];
+        }
+    }
+    if (count > 0) {
+        faceNormalsValid = false;
+    }
+    return count;
+}
+
+void RectCloth::
+gatherToVertices(const std::vector<glm::vec3>& perTriangle, std::vector<glm::vec3>& perVertex) const {
+    perVertex.resize(nw * nh);
+
+    // Each vertex is visited once and reads its (up to six) incident triangles, so no two writes collide
+    const unsigned int nq = nw - 1;
+    for (unsigned int ih = 0; ih < nh; ++ih) {
+        for (unsigned int iw = 0; iw < nw; ++iw) {
+            glm::vec3 sum(0.0f);
+            if (iw < nw - 1 && ih < nh - 1) { // vertex is leftDown of quad (iw, ih)
+                unsigned int q = ih * nq + iw;
+                sum += perTriangle[2 * q] + perTriangle[2 * q + 1];
+            }
+            if (iw > 0 && ih < nh - 1) { // rightDown of quad (iw - 1, ih)
+                sum += perTriangle[2 * (ih * nq + iw - 1)];
+            }
+            if (iw > 0 && ih > 0) { // rightUp of quad (iw - 1, ih - 1)
+                unsigned int q = (ih - 1) * nq + iw - 1;
+                sum += perTriangle[2 * q] + perTriangle[2 * q + 1];
+            }
+            if (iw < nw - 1 && ih > 0) { // leftUp of quad (iw, ih - 1)
+                sum += perTriangle[2 * ((ih - 1) * nq + iw) + 1];
+            }
+            perVertex[ih * nw + iw] = sum;
+        }
+    }
+}
+
+MemoryFootprint RectCloth::
+memoryFootprint() const {
+    MemoryFootprint footprint;
+    footprint.vertices = vectorBytes(positions);
+    footprint.topology = vectorBytes(triangles) + vectorBytes(torn) + vectorBytes(tornTriangles);
+    footprint.scratch = vectorBytes(faceNormals);
+    return footprint;
+}
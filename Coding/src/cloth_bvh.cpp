@@ -0,0 +1,208 @@
+#include "cloth_bvh.hpp"
+
+ClothBvh::
+ClothBvh(RectCloth* cloth, unsigned int leafQuads) : cloth(cloth), leafQuads(leafQuads) {
+    nodes.reserve(2 * ((cloth->nw - 1) * (cloth->nh - 1) / leafQuads + 1));
+    build(0, 0, cloth->nw - 1, cloth->nh - 1, 0);
+    refit(cloth->getPositions());
+}
+
+int ClothBvh::
+build(unsigned int iw0, unsigned int ih0, unsigned int iw1, unsigned int ih1, unsigned int depth) {
+    int idx = (int)nodes.size();
+    nodes.emplace_back();
+    nodes[idx].iw0 = iw0; nodes[idx].ih0 = ih0;
+    nodes[idx].iw1 = iw1; nodes[idx].ih1 = ih1;
+    if (levels.size() <= depth) {
+        levels.resize(depth + 1);
+    }
+    levels[depth].push_back((unsigned int)idx);
+
+    // Split the longer side of the quad rectangle in half
+    unsigned int w = iw1 - iw0, h = ih1 - ih0;
+    if (w * h <= leafQuads) {
+        return idx;
+    }
+    int left, right;
+    if (w >= h) {
+        unsigned int mid = iw0 + w / 2;
+        left = build(iw0, ih0, mid, ih1, depth + 1);
+        right = build(mid, ih0, iw1, ih1, depth + 1);
+    } else {
+        unsigned int mid = ih0 + h / 2;
+        left = build(iw0, ih0, iw1, mid, depth + 1);
+        right = build(iw0, mid, iw1, ih1, depth + 1);
+    }
+    nodes[idx].left = left;
+    nodes[idx].right = right;
+    return idx;
+}
+
+void ClothBvh::
+refit(const std::vector<glm::vec3>& positions, float margin) {
+    refitLevels(positions, nullptr, margin);
+}
+
+void ClothBvh::
+refit(const std::vector<glm::vec3>& positions, const std::vector<glm::vec3>& previousPositions, float margin) {
+    refitLevels(positions, &previousPositions, margin);
+}
+
+void ClothBvh::
+refitLevels(const std::vector<glm::vec3>& positions, const std::vector<glm::vec3>* previousPositions, float margin) {
+    this->positions = &positions;
+    const unsigned int nw = cloth->nw;
+
+    // Deepest level first; nodes within a level are independent
+    for (int depth = (int)levels.size() - 1; depth >= 0; depth--) {
+        const std::vector<unsigned int>& level = levels[depth];
+        #pragma omp parallel for
+        for (int k = 0; k < (int)level.size(); k++) {
+            Node& node = nodes[level[k]];
+            if (!node.isLeaf()) {
+                node.bounds = nodes[node.left].bounds;
+                node.bounds.expand(nodes[node.right].bounds);
+                continue;
+            }
+            Aabb box;
+            for (unsigned int ih = node.ih0; ih <= node.ih1; ih++) {
+                for (unsigned int iw = node.iw0; iw <= node.iw1; iw++) {
+                    box.expand(positions[ih * nw + iw]);
+                    if (previousPositions) {
+                        box.expand((*previousPositions)[ih * nw + iw]);
+                    }
+                }
+            }
+            node.bounds = box.inflated(margin);
+        }
+    }
+}
+
+// Slab test, returns the entry distance or a negative value on a miss
+static float rayBox(const glm::vec3& origin, const glm::vec3& inverseDirection, const Aabb& box, float maxT) {
+    glm::vec3 t0 = (box.min - origin) * inverseDirection;
+    glm::vec3 t1 = (box.max - origin) * inverseDirection;
+    glm::vec3 tNear = glm::min(t0, t1), tFar = glm::max(t0, t1);
+    float enter = glm::max(glm::max(tNear.x, tNear.y), glm::max(tNear.z, 0.0f));
+    float exit = glm::min(glm::min(tFar.x, tFar.y), glm::min(tFar.z, maxT));
+    return enter <= exit ? enter : -1.0f;
+}
+
+bool ClothBvh::
+raycast(const glm::vec3& origin, const glm::vec3& direction, RayHit& hit, float maxT) const {
+    const std::vector<glm::uvec3>& triangles = cloth->getTriangles();
+    const std::vector<glm::vec3>& p = *positions;
+    const glm::vec3 inverseDirection = 1.0f / direction;
+
+    bool found = false;
+    hit.t = maxT;
+    unsigned int stack[64];
+    unsigned int top = 0;
+    stack[top++] = 0;
+    while (top > 0) {
+        const Node& node = nodes[stack[--top]];
+        if (rayBox(origin, inverseDirection, node.bounds, hit.t) < 0.0f) {
+            continue;
+        }
+        if (!node.isLeaf()) {
+            stack[top++] = (unsigned int)node.left;
+            stack[top++] = (unsigned int)node.right;
+            continue;
+        }
+        forEachTriangle(node, [&](unsigned int t) {
+            // Moller-Trumbore, double sided
+            const glm::uvec3 tri = triangles[t];
+            glm::vec3 e1 = p[tri.y] - p[tri.x], e2 = p[tri.z] - p[tri.x];
+            glm::vec3 q = glm::cross(direction, e2);
+            float det = glm::dot(e1, q);
+            if (glm::abs(det) < 1e-12f) {
+                return;
+            }
+            float invDet = 1.0f / det;
+            glm::vec3 s = origin - p[tri.x];
+            float u = glm::dot(s, q) * invDet;
+            if (u < 0.0f || u > 1.0f) {
+                return;
+            }
+            glm::vec3 r = glm::cross(s, e1);
+            float v = glm::dot(direction, r) * invDet;
+            if (v < 0.0f || u + v > 1.0f) {
+                return;
+            }
+            float t0 = glm::dot(e2, r) * invDet;
+            if (t0 >= 0.0f && t0 < hit.t) {
+                hit.t = t0;
+                hit.triangle = t;
+                hit.barycentric = glm::vec3(1.0f - u - v, u, v);
+                found = true;
+            }
+        });
+    }
+    return found;
+}
+
+bool ClothBvh::
+nearestVertex(const glm::vec3& p, unsigned int& vertex, float& distance, float maxDistance) const {
+    const std::vector<glm::vec3>& positions = *this->positions;
+    float best = maxDistance;
+    bool found = false;
+
+    // Children are pushed far first, so the near one is searched first and tightens 'best'
+    unsigned int stack[64];
+    unsigned int top = 0;
+    stack[top++] = 0;
+    while (top > 0) {
+        const Node& node = nodes[stack[--top]];
+        if (node.bounds.distanceTo(p) >= best) {
+            continue;
+        }
+        if (node.isLeaf()) {
+            forEachVertex(node, [&](unsigned int v) {
+                float d = glm::length(positions[v] - p);
+                if (d < best) {
+                    best = d;
+                    vertex = v;
+                    found = true;
+                }
+            });
+            continue;
+        }
+        float left = nodes[node.left].bounds.distanceTo(p), right = nodes[node.right].bounds.distanceTo(p);
+        if (left <= right) {
+            stack[top++] = (unsigned int)node.right;
+            stack[top++] = (unsigned int)node.left;
+        } else {
+            stack[top++] = (unsigned int)node.left;
+            stack[top++] = (unsigned int)node.right;
+        }
+    }
+    distance = best;
+    return found;
+}
+
+void ClothBvh::
+verticesWithin(const glm::vec3& center, float radius, std::vector<unsigned int>& found) const {
+    const std::vector<glm::vec3>& positions = *this->positions;
+    const float radius2 = radius * radius;
+
+    unsigned int stack[64];
+    unsigned int top = 0;
+    stack[top++] = 0;
+    while (top > 0) {
+        const Node& node = nodes[stack[--top]];
+        if (node.bounds.distanceTo(center) > radius) {
+            continue;
+        }
+        if (!node.isLeaf()) {
+            stack[top++] = (unsigned int)node.left;
+            stack[top++] = (unsigned int)node.right;
+            continue;
+        }
+        forEachVertex(node, [&](unsigned int v) {
+            glm::vec3 d = positions[v] - center;
+            if (glm::dot(d, d) <= radius2) {
+                found.push_back(v);
+            }
+        });
+    }
+}
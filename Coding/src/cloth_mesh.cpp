@@ -0,0 +1,138 @@
+#include "cloth_mesh.hpp"
+
+#include <algorithm>
+
+#include <glm/gtc/packing.hpp>
+
+ClothMesh::
+ClothMesh(RectCloth* cloth) : cloth(cloth) {
+    this->vertices.resize(cloth->nw * cloth->nh);
+    this->updatePositions();
+    this->initIndices();
+    this->updateNormals();
+}
+
+void ClothMesh::
+updatePositions() {
+    const std::vector<glm::vec3>& positions = this->cloth->getPositions();
+    const unsigned int total = (unsigned int)positions.size();
+
+    if (this->packed) {
+        for (unsigned int i = 0; i < total; ++i) {
+            this->packedVertices[i].position = positions[i];
+        }
+        return;
+    }
+    for (unsigned int i = 0; i < total; ++i) {
+        this->vertices[i].position = positions[i];
+    }
+}
+
+void ClothMesh::
+accumulateNormals() {
+    // Face normals are cached on the cloth, so they are shared with the simulator's aerodynamics pass
+    this->cloth->gatherToVertices(this->cloth->getFaceNormals(), this->vertexNormals);
+}
+
+void ClothMesh::
+normalizeNormals() {
+    const unsigned int total = (unsigned int)this->vertexNormals.size();
+    if (this->packed) {
+        for (unsigned int i = 0; i < total; ++i) {
+            this->packedVertices[i].normal = glm::packSnorm3x10_1x2(glm::vec4(glm::normalize(this->vertexNormals[i]), 0.0f));
+        }
+        return;
+    }
+    for (unsigned int i = 0; i < total; ++i) {
+        this->vertices[i].normal = glm::normalize(this->vertexNormals[i]);
+    }
+}
+
+const void* ClothMesh::
+getVertexData() const {
+    return this->packed ? (const void*)this->packedVertices.data() : (const void*)this->vertices.data();
+}
+
+size_t ClothMesh::
+getVertexBytes() const {
+    return this->packed ? sizeof(PackedVertex) * this->packedVertices.size() : sizeof(Vertex) * this->vertices.size();
+}
+
+void ClothMesh::
+setPackedNormals(bool value) {
+    if (value == this->packed) {
+        return;
+    }
+    // The unused layout is released, not just cleared
+    const unsigned int total = this->cloth->nw * this->cloth->nh;
+    this->packed = value;
+    if (value) {
+        std::vector<Vertex>().swap(this->vertices);
+        this->packedVertices.resize(total);
+    } else {
+        std::vector<PackedVertex>().swap(this->packedVertices);
+        this->vertices.resize(total);
+    }
+    this->updatePositions();
+    this->updateNormals();
+}
+
+MemoryFootprint ClothMesh::
+memoryFootprint() const {
+    MemoryFootprint footprint;
+    footprint.vertices = vectorBytes(this->vertices) + vectorBytes(this->packedVertices);
+    footprint.topology = vectorBytes(this->indices) + vectorBytes(this->triangleSlots) + vectorBytes(this->slotTriangles);
+    footprint.scratch = vectorBytes(this->vertexNormals);
+    return footprint;
+}
+
+void ClothMesh::
+initIndices() {
+    // Same triangulation the simulator uses for its face normals
+    const std::vector<glm::uvec3>& triangles = this->cloth->getTriangles();
+
+    this->indices.clear();
+    this->indices.reserve(triangles.size() * 3);
+    this->triangleSlots.clear();
+    this->slotTriangles.clear();
+    for (unsigned int t = 0; t < triangles.size(); t++) {
+        if (this->cloth->isTorn(t)) {
+            this->triangleSlots.push_back(0u);
+            continue;
+        }
+        this->triangleSlots.push_back((unsigned int)this->slotTriangles.size());
+        this->slotTriangles.push_back(t);
+        this->indices.push_back(triangles[t].x);
+        this->indices.push_back(triangles[t].y);
+        this->indices.push_back(triangles[t].z);
+    }
+    this->liveTriangles = (unsigned int)this->slotTriangles.size();
+    this->tearsSeen = (unsigned int)this->cloth->getTornTriangles().size();
+    this->dirtyBegin = 0;
+    this->dirtyEnd = this->liveTriangles;
+}
+
+void ClothMesh::
+updateIndices() {
+    // Swap-pop every triangle torn since the last frame: the last live slot moves into its place
+    const std::vector<unsigned int>& torn = this->cloth->getTornTriangles();
+    for (; this->tearsSeen < torn.size(); this->tearsSeen++) {
+        unsigned int slot = this->triangleSlots[torn[this->tearsSeen]];
+        unsigned int last = --this->liveTriangles;
+        if (slot != last) {
+            unsigned int moved = this->slotTriangles[last];
+            for (unsigned int k = 0; k < 3; k++) {
+                this->indices[3 * slot + k] = this->indices[3 * last + k];
+            }
+            this->slotTriangles[slot] = moved;
+            this->triangleSlots[moved] = slot;
+            if (dirtyBegin == dirtyEnd) {
+                dirtyBegin = slot;
+                dirtyEnd = slot + 1;
+            } else {
+                dirtyBegin = std::min(dirtyBegin, slot);
+                dirtyEnd = std::max(dirtyEnd, slot + 1);
+            }
+        }
+    }
+}
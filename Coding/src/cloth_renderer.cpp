@@ -1,30 +1,40 @@
 #include "cloth_renderer.hpp"
+#include "allocation_tracker.hpp"
+#include "trace.hpp"
 
 RectClothRenderer::
 RectClothRenderer(
     Shader* shader,
     FirstPersonCamera* camera,
     RectCloth* cloth
-) {
+) : mesh(cloth) {
     this->shader = shader;
     this->camera = camera;
     this->cloth = cloth;
 
-    this->initVertices();
-    this->initIndices();
-    this->updateNormals();
-
-    this->glo.initData();
+    this->glo.initData(this->mesh);
+    this->mesh.clearDirty();
 }
 
 void RectClothRenderer::
 draw() {
-    this->updatePositions();
-    this->updateNormals();
+    CLOTH_TRACE_SCOPE("cloth_draw");
+    CLOTH_ASSERT_NO_ALLOCATIONS("RectClothRenderer::draw", drawRuns, 2);
+    {
+        CLOTH_TRACE_SCOPE("cloth_positions");
+        this->mesh.updatePositions();
+    }
+    {
+        CLOTH_TRACE_SCOPE("cloth_normals");
+        this->mesh.updateNormals();
+    }
 
     // Update Data
-    glBindBuffer(GL_ARRAY_BUFFER, glo.VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(VertexData) * this->glo.vertices.size(), this->glo.vertices.data(), GL_STREAM_DRAW);
+    {
+        CLOTH_TRACE_SCOPE("cloth_upload");
+        glBindBuffer(GL_ARRAY_BUFFER, glo.VBO);
+        glBufferData(GL_ARRAY_BUFFER, this->mesh.getVertexBytes(), this->mesh.getVertexData(), GL_STREAM_DRAW);
+    }
 
     GLint previous;
     glGetIntegerv(GL_POLYGON_MODE, &previous);
@@ -37,9 +47,18 @@ draw() {
     glBindVertexArray(glo.VAO);
     glBindBuffer(GL_ARRAY_BUFFER, glo.VBO);
 
+    // Only the slots that torn triangles were compacted into go up, the element buffer is part of the VAO
+    this->mesh.updateIndices();
+    const unsigned int dirtyBegin = this->mesh.getDirtyBegin(), dirtyEnd = this->mesh.getDirtyEnd();
+    if (dirtyBegin < dirtyEnd) {
+        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * 3 * dirtyBegin,
+                        sizeof(GLuint) * 3 * (dirtyEnd - dirtyBegin), this->mesh.getIndices().data() + 3 * dirtyBegin);
+        this->mesh.clearDirty();
+    }
+
     this->shader->setBool("DrawLine", false);
     glPolygonMode(GL_FRONT_AND_BACK, GL_FLAT); // We want flat mode
-    glDrawElements(GL_TRIANGLES, (int)glo.indices.size(), GL_UNSIGNED_INT, NULL);
+    glDrawElements(GL_TRIANGLES, (int)(3 * this->mesh.getLiveTriangles()), GL_UNSIGNED_INT, NULL);
 
     // this->shader->setBool("DrawLine", true);
     // glPolygonMode(GL_FRONT_AND_BACK, GL_LINE); // We want line mode
@@ -51,95 +70,21 @@ draw() {
     glPolygonMode(GL_FRONT_AND_BACK, previous); // restore previous mode
 }
 
-void RectClothRenderer::
-initVertices() {
-    const unsigned int nh = this->cloth->nh;
-    const unsigned int nw = this->cloth->nw;
-    const unsigned int total = nh * nw;
-
-    this->glo.vertices.clear();
-    this->glo.vertices.resize(total);
-
-    for (unsigned int i = 0; i < total; ++i) {
-        this->glo.vertices[i].position = this->cloth->getPosition(i);
-    }
+MemoryFootprint RectClothRenderer::
+memoryFootprint() const {
+    MemoryFootprint footprint = this->mesh.memoryFootprint();
+    footprint.gpu = this->glo.vertexBytes + this->glo.indexBytes;
+    return footprint;
 }
 
-
-void RectClothRenderer::
-initIndices() {
-    this->glo.indices.clear();
-
-    const unsigned int nh = this->cloth->nh;
-    const unsigned int nw = this->cloth->nw;
-
-    this->glo.indices.reserve((nh - 1) * (nw - 1) * 6);
-    for (unsigned int ih = 0; ih < nh - 1; ++ih) {
-        for (unsigned int iw = 0; iw < nw - 1; ++iw) {
-            unsigned int leftDownIdx = this->cloth->idxFromCoord(iw, ih);
-            unsigned int rightDownIdx = this->cloth->idxFromCoord(iw + 1, ih);
-            unsigned int leftUpIdx = this->cloth->idxFromCoord(iw, ih + 1);
-            unsigned int rightUpIdx = this->cloth->idxFromCoord(iw + 1, ih + 1);
-
-            this->glo.indices.push_back(leftDownIdx);
-            this->glo.indices.push_back(rightDownIdx);
-            this->glo.indices.push_back(rightUpIdx);
-
-            this->glo.indices.push_back(leftDownIdx);
-            this->glo.indices.push_back(rightUpIdx);
-            this->glo.indices.push_back(leftUpIdx);
-        }
-    }
-}
-
-void RectClothRenderer::
-updatePositions() {
-    const unsigned int nh = this->cloth->nh;
-    const unsigned int nw = this->cloth->nw;
-    const unsigned int total = nh * nw;
-
-    for (unsigned int i = 0; i < total; ++i) {
-        this->glo.vertices[i].position = this->cloth->getPosition(i);
+bool RectClothRenderer::
+setMemoryBudget(size_t bytes) {
+    if (bytes > 0 && !this->mesh.isPacked() && this->memoryFootprint().total() > bytes) {
+        // The buffers are reallocated in the new layout, with the live triangles' indices
+        this->mesh.setPackedNormals(true);
+        this->mesh.updateIndices();
+        this->glo.initData(this->mesh);
+        this->mesh.clearDirty();
     }
+    return bytes == 0 || this->memoryFootprint().total() <= bytes;
 }
-
-void RectClothRenderer::
-updateNormals() {
-    const unsigned int nh = this->cloth->nh;
-    const unsigned int nw = this->cloth->nw;
-    const unsigned int total = nh * nw;
-
-    for (unsigned int i = 0; i < total; ++i) {
-        this->glo.vertices[i].normal = glm::vec3(0);
-    }
-
-    for (unsigned int ih = 0; ih < nh - 1; ++ih) {
-        for (unsigned int iw = 0; iw < nw - 1; ++iw) {
-            unsigned int leftDownIdx = this->cloth->idxFromCoord(iw, ih);
-            unsigned int rightDownIdx = this->cloth->idxFromCoord(iw + 1, ih);
-            unsigned int leftUpIdx = this->cloth->idxFromCoord(iw, ih + 1);
-            unsigned int rightUpIdx = this->cloth->idxFromCoord(iw + 1, ih + 1);
-
-            unsigned int lower[3] = {leftDownIdx, rightDownIdx, rightUpIdx};
-            unsigned int upper[3] = {leftDownIdx, rightUpIdx, leftUpIdx};
-            glm::vec3 lowerNormal = calcNormal(
-                this->glo.vertices[leftDownIdx].position,
-                this->glo.vertices[rightDownIdx].position,
-                this->glo.vertices[rightUpIdx].position
-            );
-            glm::vec3 upperNormal = calcNormal(
-                this->glo.vertices[leftDownIdx].position,
-                this->glo.vertices[rightUpIdx].position,
-                this->glo.vertices[leftUpIdx].position
-            );
-            for (int i = 0; i < 3; ++i) {
-                this->glo.vertices[lower[i]].normal += lowerNormal;
-                this->glo.vertices[upper[i]].normal += upperNormal;
-            }
-        }
-    }
-
-    for (unsigned int i = 0; i < total; ++i) {
-        this->glo.vertices[i].normal = glm::normalize(this->glo.vertices[i].normal);
-    }
-}
\ No newline at end of file
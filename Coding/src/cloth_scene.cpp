@@ -0,0 +1,68 @@
+#include "cloth_scene.hpp"
+
+#include "allocation_tracker.hpp"
+
+ClothScene::
+ClothScene(float thickness) : thickness(thickness) {}
+
+void ClothScene::
+add(RectClothSimulator* simulator) {
+    order.push_back((unsigned int)simulators.size());
+    simulators.push_back(simulator);
+    bounds.emplace_back();
+}
+
+void ClothScene::
+step(float timeStep) {
+    for (RectClothSimulator* simulator : simulators) {
+        simulator->solveStep(timeStep);
+    }
+
+    // Before the steps finish, so that drag, tearing and the cloths' positions see the contacts
+    findPairs();
+    if (!pairs.empty()) {
+        for (RectClothSimulator* simulator : simulators) {
+            simulator->beginClothContacts();
+        }
+        for (const glm::uvec2& pair : pairs) {
+            simulators[pair.x]->collideWith(*simulators[pair.y], thickness);
+            simulators[pair.y]->collideWith(*simulators[pair.x], thickness);
+        }
+        for (RectClothSimulator* simulator : simulators) {
+            simulator->endClothContacts();
+        }
+    }
+
+    for (RectClothSimulator* simulator : simulators) {
+        simulator->finishStep(timeStep);
+    }
+}
+
+void ClothScene::
+findPairs() {
+    for (unsigned int c = 0; c < simulators.size(); c++) {
+        bounds[c] = simulators[c]->getBvh().bounds().inflated(0.5f * thickness);
+    }
+
+    // Insertion sort: the order barely changes from one step to the next
+    for (unsigned int k = 1; k < order.size(); k++) {
+        unsigned int c = order[k];
+        unsigned int j = k;
+        while (j > 0 && bounds[order[j - 1]].min.x > bounds[c].min.x) {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = c;
+    }
+
+    // Sweep: a cloth only meets the ones that start before it ends on x
+    pairs.clear();
+    for (unsigned int k = 0; k < order.size(); k++) {
+        const Aabb& box = bounds[order[k]];
+        for (unsigned int j = k + 1; j < order.size() && bounds[order[j]].min.x <= box.max.x; j++) {
+            if (box.overlaps(bounds[order[j]])) {
+                pushScratch(pairs, glm::uvec2(order[k], order[j]));
+            }
+        }
+    }
+}
@@ -1,11 +1,12 @@
+#include <algorithm>
 #include <cmath>
+#include <cstdlib>
 #include <iostream>
+#include <limits>
 #include "cloth_simulator.hpp"
-#include "GLFW/glfw3.h"
-
-glm::vec3 wind(glm::vec3 position, float time) {
-    return glm::vec3(sin(position.x * position.y * time), cos(position.z * time), sin(cos(5 * position.x * position.y * position.z)));
-}
+#include "allocation_tracker.hpp"
+#include "ccd.hpp"
+#include "geometry.hpp"
 
 RectClothSimulator::
 RectClothSimulator(
@@ -13,20 +14,62 @@ RectClothSimulator(
         float totalMass,
         float stiffnessReference,
         float airResistanceCoefficient,
-        const glm::vec3& gravity) : cloth(cloth), airResistanceCoefficient(airResistanceCoefficient), gravity(gravity) {
+        const glm::vec3& gravity) : cloth(cloth), airResistanceCoefficient(airResistanceCoefficient), gravity(gravity), bvh(cloth) {
+    // A particle crossing the other layer through the middle of a quad is dx / sqrt(2) from all
+    //  four corners, so contact starts just past that; grid neighbours are skipped, and the next
+    //  ring rests 2 dx away
+    selfCollisionThickness = 0.75f * cloth->dx;
+    selfCollisionHash.setCellSize(selfCollisionThickness);
+    ccdThickness = 0.05f * cloth->dx;
+    contactCache.margin = 0.1f * cloth->dx;
+    // Below the closest non-adjacent features of the grid, dx / sqrt(2), even when sheared
+    barrierDistance = 0.1f * cloth->dx;
+
+    // Unique edges of the triangulation, for edge-edge continuous tests
+    for (const glm::uvec3& tri : cloth->getTriangles()) {
+        for (unsigned int k = 0; k < 3; k++) {
+            unsigned int a = tri[k], b = tri[(k + 1) % 3];
+            edges.push_back(glm::uvec2(glm::min(a, b), glm::max(a, b)));
+        }
+    }
+    std::sort(edges.begin(), edges.end(), [](const glm::uvec2& l, const glm::uvec2& r) {
+        return l.x < r.x || (l.x == r.x && l.y < r.y);
+    });
+    edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+    deadEdges.assign(edges.size(), 0);
+
+    // Every edge is owned by the first triangle listing it, so that queries see it once
+    std::vector<bool> listed(edges.size(), false);
+    const std::vector<glm::uvec3>& triangles = cloth->getTriangles();
+    ownedEdges.assign(triangles.size(), 0);
+    for (unsigned int t = 0; t < triangles.size(); t++) {
+        for (unsigned int k = 0; k < 3; k++) {
+            unsigned int a = triangles[t][k], b = triangles[t][(k + 1) % 3];
+            unsigned int e = findEdge(glm::uvec2(glm::min(a, b), glm::max(a, b)));
+            if (!listed[e]) {
+                listed[e] = true;
+                ownedEdges[t] |= (unsigned char)(1u << k);
+            }
+        }
+    }
+
     // Initialize particles, then springs according to the given cloth
     createMassParticles(totalMass);
     createSprings(stiffnessReference);
+
+    // Contacts hold about ten particle weights at half the barrier distance
+    barrierStiffness = 10.0f * particles[0].mass * glm::max(glm::length(gravity), 1.0f) / barrierDistance;
 }
 
 void RectClothSimulator::
 createMassParticles(float totalMass) {
     // Create mass particles based on given cloth.
     particles.resize(cloth->nw * cloth->nh);
+    positions.resize(cloth->nw * cloth->nh);
     for (unsigned int ih = 0; ih < cloth->nh; ih++) {
         for (unsigned int iw = 0; iw < cloth->nw; iw++) {
             MassParticle particle;
-            particle.position = cloth->getPosition(iw, ih);
+            positions[cloth->idxFromCoord(iw, ih)] = cloth->getPosition(iw, ih);
 
             // TODO: Initialize other mass properties.
             //  Use 'cloth->...' to access cloth properties.
@@ -148,6 +191,12 @@ createSprings(float stiffnessReference) {
 
 void RectClothSimulator::
 step(float timeStep) {
+    solveStep(timeStep);
+    finishStep(timeStep);
+}
+
+void RectClothSimulator::
+solveStep(float timeStep) {
     // TODO: Simulate one step based on given time step.
     //  Step 1: Update particle positions
     //  Step 2: Update springs
@@ -155,55 +204,1442 @@ step(float timeStep) {
     //  Hint: See cloth_simulator.hpp to check for member variables you need.
     //  Hint: You may use 'cloth->getInitialPosition(...)' for constraints.
     // MY CODE HERE
+    CLOTH_TRACE_SCOPE("step");
+    CLOTH_ASSERT_NO_ALLOCATIONS("RectClothSimulator::solveStep", solveRuns, 2);
+    health = StepHealth();
+    if (is_barrier) {
+        // Wind acts within the step here, the solve replaces steps 1 to 3
+        if (is_wind) {
+            PhaseScope phase(observer, StepPhase::Wind);
+            applyWind();
+        }
+        {
+            PhaseScope phase(observer, StepPhase::Barrier);
+            stepBarrier(timeStep);
+        }
+        return;
+    }
+
     // Step 1
-    for (unsigned int i = 0u; i < particles.size(); i++)
     {
-        if (!is_collision && (i == 0u || i == cloth->nw - 1)) { continue; }
-        particles[i].force += gravity * particles[i].mass;
-        
-        glm::vec3 airResistance = particles[i].velocity == glm::vec3(0.0f) ? 
-            glm::vec3(0.0f) : -airResistanceCoefficient 
-                * dot(particles[i].velocity, particles[i].velocity) 
-                * normalize(particles[i].velocity);
-        particles[i].force += airResistance;
-        particles[i].velocity += particles[i].force / particles[i].mass * timeStep;
-        particles[i].position += particles[i].velocity * timeStep;
-        particles[i].force = glm::vec3(0.0f);
+        PhaseScope phase(observer, StepPhase::Integrate);
+        if (is_ccd) {
+            previousPositions = positions;
+        }
+        double kinetic = 0.0;
+        unsigned int pinned = 0;
+        for (unsigned int i = 0u; i < particles.size(); i++)
+        {
+            if (isPinned(i)) { pinned++; continue; }
+            particles[i].force += gravity * particles[i].mass;
+
+            // The isotropic model is only a fallback, the aerodynamics pass replaces it
+            if (!is_aerodynamic) {
+                glm::vec3 airResistance = particles[i].velocity == glm::vec3(0.0f) ?
+                    glm::vec3(0.0f) : -airResistanceCoefficient
+                        * dot(particles[i].velocity, particles[i].velocity)
+                        * normalize(particles[i].velocity);
+                particles[i].force += airResistance;
+            }
+            particles[i].velocity += particles[i].force / particles[i].mass * timeStep;
+            positions[i] += particles[i].velocity * timeStep;
+            particles[i].force = glm::vec3(0.0f);
+            kinetic += 0.5 * particles[i].mass * glm::dot(particles[i].velocity, particles[i].velocity);
+        }
+        health.kineticEnergy = kinetic;
+        health.pinned = pinned;
     }
     // Step 2
-    for (unsigned int i = 0u; i < springs.size(); i++)
     {
-        MassParticle& fromMass = particles[springs[i].fromMassIndex];
-        MassParticle& toMass = particles[springs[i].toMassIndex];
-        glm::vec3 springVector = toMass.position - fromMass.position;
-        float springLength = glm::length(springVector);
-        glm::vec3 springDirection = springVector / springLength;
-        float springForce = springs[i].stiffness * (springLength - springs[i].restLength);
-        fromMass.force += springDirection * springForce;
-        toMass.force += -springDirection * springForce;
+        PhaseScope phase(observer, StepPhase::Springs);
+        float maxStrain = 0.0f, strainSum = 0.0f;
+        for (unsigned int i = 0u; i < springs.size(); i++)
+        {
+            MassParticle& fromMass = particles[springs[i].fromMassIndex];
+            MassParticle& toMass = particles[springs[i].toMassIndex];
+            glm::vec3 springVector = positions[springs[i].toMassIndex] - positions[springs[i].fromMassIndex];
+            float springLength = glm::length(springVector);
+            glm::vec3 springDirection = springVector / springLength;
+            float springForce = springs[i].stiffness * (springLength - springs[i].restLength);
+            fromMass.force += springDirection * springForce;
+            toMass.force += -springDirection * springForce;
+
+            float strain = std::abs(springLength / springs[i].restLength - 1.0f);
+            maxStrain = glm::max(maxStrain, strain);
+            strainSum += strain;
+        }
+        health.maxStrain = maxStrain;
+        health.meanStrain = springs.empty() ? 0.0f : strainSum / (float)springs.size();
     }
     // Step 3
     if (is_wind) {
-        for (unsigned int i = 0u; i < particles.size(); i++) {
-            particles[i].force += 0.01f * wind(particles[i].position, glfwGetTime());   
+        PhaseScope phase(observer, StepPhase::Wind);
+        applyWind();
+    } else if (is_collision && colliders) {
+        PhaseScope phase(observer, StepPhase::Collision);
+        // Swept first so that fast particles cannot tunnel, the discrete pass then handles resting contact
+        if (is_ccd) {
+            resolveContinuousCollisions();
         }
-    } else if (is_collision) {
-        for (unsigned int i = 0u; i < particles.size(); i++) {
-            if (glm::length(particles[i].position - center) < collision_radius) {
-                particles[i].position = glm::normalize(particles[i].position - center) * collision_radius + center;
-            }
+        // Row tiles are tested only against the colliders their bounding boxes touch
+        health.contacts += colliders->resolve(positions, contactCache, cloth->nw * collisionTileRows);
+        applyContactVelocities();
+        if (is_triangle_contact) {
+            resolveTriangleContacts();
+        }
+    }
+    if (is_self_collision) {
+        PhaseScope phase(observer, StepPhase::SelfCollision);
+        resolveSelfCollisions();
+        if (is_ccd) {
+            resolveContinuousSelfCollisions(timeStep);
         }
     }
     // MY CODE END
+}
+
+void RectClothSimulator::
+finishStep(float timeStep) {
+    // Shared by both kinds of step, once the positions are final
+    CLOTH_ASSERT_NO_ALLOCATIONS("RectClothSimulator::finishStep", finishRuns, 2);
+    applyDrag(timeStep);
+    if (is_tearing) {
+        PhaseScope phase(observer, StepPhase::Tearing);
+        tearSprings();
+    }
 
     // Finally update cloth data
-    updateCloth();
+    {
+        PhaseScope phase(observer, StepPhase::Update);
+        updateCloth();
+        bvhValid = false;
+    }
+
+    // Face normals are computed on the cloth, where the renderer reuses them
+    if (is_aerodynamic) {
+        PhaseScope phase(observer, StepPhase::Aerodynamics);
+        applyAerodynamics(timeStep);
+    }
+    time += timeStep;
+
+    health.time = time;
+    health.step = healthSnapshot.step + 1;
+    std::lock_guard<std::mutex> lock(healthMutex);
+    healthSnapshot = health;
+}
+
+StepHealth RectClothSimulator::
+getHealth() const {
+    std::lock_guard<std::mutex> lock(healthMutex);
+    return healthSnapshot;
+}
+
+void RectClothSimulator::
+applyWind() {
+    // Time is sampled once per step, the field itself is a table lookup
+    windField.setTime(time);
+    if (!is_aerodynamic) {
+        windField.sample(positions, windForces);
+        for (unsigned int i = 0u; i < particles.size(); i++) {
+            particles[i].force += windScale * windForces[i];
+        }
+    }
+}
+
+void RectClothSimulator::
+applyAerodynamics(float timeStep) {
+    const std::vector<glm::uvec3>& triangles = cloth->getTriangles();
+    const std::vector<glm::vec3>& faceNormals = cloth->getFaceNormals();
+    const int count = (int)triangles.size();
+
+    resizeScratch(triangleCentroids, count);
+    resizeScratch(triangleVelocities, count);
+    for (int t = 0; t < count; t++) {
+        glm::uvec3 tri = triangles[t];
+        triangleCentroids[t] = (positions[tri.x] + positions[tri.y] + positions[tri.z]) / 3.0f;
+        triangleVelocities[t] = (particles[tri.x].velocity + particles[tri.y].velocity + particles[tri.z].velocity) / 3.0f;
+    }
+
+    // The grid carries the mean flow and the cloth's wake, the field adds small-scale turbulence
+    if (is_wind) {
+        windField.sample(triangleCentroids, airVelocities);
+    } else {
+        assignScratch(airVelocities, count, glm::vec3(0.0f));
+    }
+    if (windGrid) {
+        windGrid->sample(triangleCentroids, gridVelocities);
+        for (int t = 0; t < count; t++) {
+            airVelocities[t] += gridVelocities[t];
+        }
+    }
+
+    // Flat plate model: with u the relative air velocity and theta its angle to the face,
+    //  F = 1/2 rho A |u|^2 cos(theta) (Cd cos(theta) u^ + Cl (n - cos(theta) u^))
+    // The first term is drag along the flow, the second lift across it.
+    const float halfRho = 0.5f * airDensity;
+    resizeScratch(triangleForces, count);
+    const float dragMinusLift = dragCoefficient - liftCoefficient, lift = liftCoefficient;
+    // As plain floats: GCC cannot vectorise loads through glm::vec3's members
+    static_assert(sizeof(glm::vec3) == 3 * sizeof(float));
+    const float* normals = &faceNormals.data()->x;
+    const float* air = &airVelocities.data()->x;
+    const float* velocities = &triangleVelocities.data()->x;
+    float* forces = &triangleForces.data()->x;
+
+    // Branch free, so that it vectorises: degenerate faces and still air come out as zero
+    //  through the guarded divisions
+    #pragma omp simd
+    for (int t = 0; t < count; t++) {
+        float ux = air[3 * t] - velocities[3 * t];
+        float uy = air[3 * t + 1] - velocities[3 * t + 1];
+        float uz = air[3 * t + 2] - velocities[3 * t + 2];
+        float nx = normals[3 * t], ny = normals[3 * t + 1], nz = normals[3 * t + 2];
+        float doubleArea = std::sqrt(nx * nx + ny * ny + nz * nz);
+        float inverseArea = 1.0f / (doubleArea + 1e-30f);
+        nx *= inverseArea; ny *= inverseArea; nz *= inverseArea;
+        float uu = ux * ux + uy * uy + uz * uz;
+        float un = ux * nx + uy * ny + uz * nz;
+        float k = halfRho * 0.5f * doubleArea * std::sqrt(uu);
+
+        float along = k * dragMinusLift * un * un / (uu + 1e-12f), across = k * lift * un;
+        forces[3 * t] = along * ux + across * nx;
+        forces[3 * t + 1] = along * uy + across * ny;
+        forces[3 * t + 2] = along * uz + across * nz;
+    }
+
+    // Each vertex takes a third of the force of every incident triangle
+    cloth->gatherToVertices(triangleForces, vertexForces);
+    for (unsigned int i = 0u; i < particles.size(); i++) {
+        particles[i].force += vertexForces[i] / 3.0f;
+    }
+
+    // Equal and opposite momentum goes back into the air
+    if (windGrid) {
+        for (int t = 0; t < count; t++) {
+            gridVelocities[t] = -triangleForces[t] * timeStep;
+        }
+        windGrid->splat(triangleCentroids, gridVelocities);
+    }
+}
+
+void RectClothSimulator::
+applyDrag(float timeStep) {
+    if (dragParticle < 0 || isAnchored(dragParticle)) {
+        return;
+    }
+    // Kinematic: the other passes treat the particle as pinned, here it closes the gap
+    //  exponentially and carries the matching velocity, its neighbours follow through the springs
+    glm::vec3 move = glm::min(timeStep / dragResponse, 1.0f) * (dragTarget - positions[dragParticle]);
+    positions[dragParticle] += move;
+    particles[dragParticle].velocity = move / timeStep;
+}
+
+bool RectClothSimulator::
+raycast(const glm::vec3& origin, const glm::vec3& direction, ClothBvh::RayHit& hit) {
+    return getBvh().raycast(origin, direction, hit);
+}
+
+bool RectClothSimulator::
+nearestParticle(const glm::vec3& p, unsigned int& idx, float maxDistance) {
+    float distance;
+    return getBvh().nearestVertex(p, idx, distance, maxDistance);
+}
+
+void RectClothSimulator::
+particlesWithin(const glm::vec3& center, float radius, std::vector<unsigned int>& found) {
+    found.clear();
+    getBvh().verticesWithin(center, radius, found);
+}
+
+double RectClothSimulator::
+totalEnergy() const {
+    double kinetic = 0.0, elastic = 0.0, gravitational = 0.0;
+    #pragma omp parallel for reduction(+:kinetic, gravitational)
+    for (int i = 0; i < (int)particles.size(); i++) {
+        const MassParticle& particle = particles[i];
+        kinetic += 0.5 * particle.mass * glm::dot(particle.velocity, particle.velocity);
+        gravitational -= particle.mass * glm::dot(gravity, positions[i]);
+    }
+    // Every pair has a spring in both directions (or one of twice the stiffness once merged), each one
+    //  exerts its full force
+    #pragma omp parallel for reduction(+:elastic)
+    for (int s = 0; s < (int)springs.size(); s++) {
+        const Spring& spring = springs[s];
+        float stretch = glm::length(positions[spring.toMassIndex] - positions[spring.fromMassIndex]) - spring.restLength;
+        elastic += 0.5 * spring.stiffness * stretch * stretch;
+    }
+    return kinetic + elastic + gravitational;
+}
+
+bool RectClothSimulator::
+estimateTraffic(StepPhase phase, double& bytes, double& flops) const {
+    // Every array a pass walks counts once (neighbour reads are taken to hit the cache, write
+    //  allocation is ignored), and every +, -, *, / or sqrt is one flop
+    const double n = (double)particles.size();
+    const double s = (double)springs.size();
+    const double t = (double)cloth->getTriangles().size();
+    const double particle = (double)sizeof(MassParticle);
+    const double vec = (double)sizeof(glm::vec3);
+    switch (phase) {
+        case StepPhase::Integrate:
+            // particle read and written, positions read and written; gravity, drag, velocity, position
+            bytes = n * (2.0 * particle + 2.0 * vec);
+            flops = n * 41.0;
+            return true;
+        case StepPhase::Springs:
+            // springs read, positions read, forces accumulated on the particles
+            bytes = s * (double)sizeof(Spring) + n * (vec + 2.0 * particle);
+            flops = s * 26.0;
+            return true;
+        case StepPhase::Wind:
+            // With aerodynamics the wind only reaches the plates, see there. Otherwise positions
+            //  read and the field sampled into windForces (its table taken to hit the cache), then
+            //  windForces read and added to the particles; trilinear weights and three 8-tap sums
+            if (is_aerodynamic) {
+                return false;
+            }
+            bytes = n * (3.0 * vec + 2.0 * particle);
+            flops = n * 79.0;
+            return true;
+        case StepPhase::Update:
+            bytes = n * 2.0 * vec;
+            flops = 0.0;
+            return true;
+        case StepPhase::Aerodynamics:
+            // face normals, centroids and velocities, plate forces, the gather and the particle update
+            bytes = t * (2.0 * sizeof(glm::uvec3) + 2.0 * vec) + t * (3.0 * vec)
+                + t * (5.0 * vec) + t * vec + n * (2.0 * vec + 3.0 * particle);
+            flops = t * 87.0 + n * 6.0;
+            return true;
+        default:
+            return false;
+    }
+}
+
+MemoryFootprint RectClothSimulator::
+memoryFootprint() const {
+    MemoryFootprint footprint = cloth->memoryFootprint();
+    footprint.particles += vectorBytes(particles) + vectorBytes(positions) + vectorBytes(previousPositions);
+
+    size_t adjacency = 0;
+    for (const MassParticle& particle : particles) {
+        adjacency += vectorBytes(particle.connectedSpringStartIndices) + vectorBytes(particle.connectedSpringEndIndices);
+    }
+    footprint.topology += vectorBytes(springs) + adjacency + vectorBytes(edges) + vectorBytes(deadEdges) + vectorBytes(ownedEdges) + bvh.memoryBytes();
+
+    footprint.scratch += contactCache.memoryBytes() + selfCollisionHash.memoryBytes() + windField.memoryBytes()
+        + vectorBytes(positionCorrections) + vectorBytes(velocityCorrections) + vectorBytes(contactCorrections)
+        + vectorBytes(clothPositionCorrections) + vectorBytes(clothVelocityCorrections) + vectorBytes(hitNormals)
+        + vectorBytes(vertexImpactTimes) + vectorBytes(vertexImpactTriangles) + vectorBytes(edgeImpactTimes)
+        + vectorBytes(edgeImpactEdges) + vectorBytes(impulseCorrections) + vectorBytes(barrierContacts) + vectorBytes(barrierTileContacts)
+        + vectorBytes(colliderBoxes) + vectorBytes(inertiaTargets) + vectorBytes(trialPositions)
+        + vectorBytes(newtonGradient) + vectorBytes(newtonDirection) + vectorBytes(springHessians)
+        + vectorBytes(blockPreconditioner) + vectorBytes(cgResidual) + vectorBytes(cgPreconditioned)
+        + vectorBytes(cgSearch) + vectorBytes(cgProduct) + vectorBytes(windForces) + vectorBytes(triangleCentroids)
+        + vectorBytes(triangleVelocities) + vectorBytes(airVelocities) + vectorBytes(triangleForces)
+        + vectorBytes(vertexForces) + vectorBytes(gridVelocities);
+    return footprint;
+}
+
+bool RectClothSimulator::
+setMemoryBudget(size_t bytes) {
+    memoryBudget = bytes;
+    if (memoryBudget > 0 && !springsMerged && memoryFootprint().total() > memoryBudget) {
+        mergeSpringPairs();
+    }
+    return memoryBudget == 0 || memoryFootprint().total() <= memoryBudget;
+}
+
+void RectClothSimulator::
+mergeSpringPairs() {
+    // Opposite springs of a pair sit next to each other once sorted by their (lower, higher) ends
+    auto ends = [](const Spring& spring) {
+        return glm::uvec2(glm::min(spring.fromMassIndex, spring.toMassIndex), glm::max(spring.fromMassIndex, spring.toMassIndex));
+    };
+    std::sort(springs.begin(), springs.end(), [&](const Spring& l, const Spring& r) {
+        glm::uvec2 a = ends(l), b = ends(r);
+        return a.x < b.x || (a.x == b.x && a.y < b.y);
+    });
+    std::vector<Spring> merged;
+    merged.reserve(springs.size() / 2 + 1);
+    for (const Spring& spring : springs) {
+        if (!merged.empty() && ends(merged.back()) == ends(spring)) {
+            merged.back().stiffness += spring.stiffness;
+        } else {
+            merged.push_back(spring);
+        }
+    }
+    springs.swap(merged);
+
+    // The adjacency lists are rebuilt at their new (halved) length
+    for (MassParticle& particle : particles) {
+        std::vector<unsigned int>().swap(particle.connectedSpringStartIndices);
+        std::vector<unsigned int>().swap(particle.connectedSpringEndIndices);
+    }
+    for (unsigned int s = 0; s < springs.size(); s++) {
+        particles[springs[s].fromMassIndex].connectedSpringStartIndices.push_back(s);
+        particles[springs[s].toMassIndex].connectedSpringEndIndices.push_back(s);
+    }
+    if (!springHessians.empty()) {
+        springHessians.resize(springs.size());
+        springHessians.shrink_to_fit();
+    }
+    springsMerged = true;
+}
+
+const ClothBvh& RectClothSimulator::
+getBvh() {
+    if (!bvhValid) {
+        bvh.refit(positions);
+        bvhValid = true;
+    }
+    return bvh;
+}
+
+// Swap-pop 'value' out of an adjacency list
+static void eraseValue(std::vector<unsigned int>& list, unsigned int value) {
+    for (unsigned int k = 0; k < list.size(); k++) {
+        if (list[k] == value) {
+            list[k] = list.back();
+            list.pop_back();
+            return;
+        }
+    }
+}
+
+static void replaceValue(std::vector<unsigned int>& list, unsigned int value, unsigned int replacement) {
+    for (unsigned int& entry : list) {
+        if (entry == value) {
+            entry = replacement;
+            return;
+        }
+    }
+}
+
+void RectClothSimulator::
+tearSprings() {
+    // Descending, so the spring swapped into a removed slot has been checked already
+    for (int s = (int)springs.size() - 1; s >= 0; s--) {
+        const Spring& spring = springs[s];
+        float length = glm::length(positions[spring.toMassIndex] - positions[spring.fromMassIndex]);
+        if (length > (1.0f + tearStrain) * spring.restLength) {
+            removeSpring((unsigned int)s);
+        }
+    }
+}
+
+void RectClothSimulator::
+removeSpring(unsigned int idx) {
+    // Swap-pop: the last spring takes the slot, and its two particles are pointed at it
+    const Spring spring = springs[idx];
+    eraseValue(particles[spring.fromMassIndex].connectedSpringStartIndices, idx);
+    eraseValue(particles[spring.toMassIndex].connectedSpringEndIndices, idx);
+    const unsigned int last = (unsigned int)springs.size() - 1;
+    if (idx != last) {
+        springs[idx] = springs[last];
+        replaceValue(particles[springs[idx].fromMassIndex].connectedSpringStartIndices, last, idx);
+        replaceValue(particles[springs[idx].toMassIndex].connectedSpringEndIndices, last, idx);
+    }
+    springs.pop_back();
+
+    // The triangles along the spring tear with it (unmerged springs come in pairs, the second finds none)
+    unsigned int removed[2];
+    unsigned int count = cloth->tearEdge(spring.fromMassIndex, spring.toMassIndex, removed);
+    for (unsigned int k = 0; k < count; k++) {
+        releaseTriangle(removed[k]);
+    }
+}
+
+void RectClothSimulator::
+releaseTriangle(unsigned int triangle) {
+    // Edges the triangle owned pass to their other triangle, or go once no triangle has them
+    const glm::uvec3 tri = cloth->getTriangles()[triangle];
+    for (unsigned int k = 0; k < 3; k++) {
+        glm::uvec2 edge(glm::min(tri[k], tri[(k + 1) % 3]), glm::max(tri[k], tri[(k + 1) % 3]));
+        unsigned int found[2];
+        unsigned int count = cloth->findEdgeTriangles(edge.x, edge.y, found);
+        int heir = -1;
+        for (unsigned int j = 0; j < count; j++) {
+            if (!cloth->isTorn(found[j])) {
+                heir = (int)found[j];
+            }
+        }
+        if (heir < 0) {
+            unsigned int e = findEdge(edge);
+            if (e < edges.size() && edges[e] == edge && !deadEdges[e]) {
+                deadEdges[e] = 1;
+                deadEdgeCount++;
+            }
+        } else if (ownedEdges[triangle] & (1u << k)) {
+            const glm::uvec3 other = cloth->getTriangles()[heir];
+            for (unsigned int j = 0; j < 3; j++) {
+                if (glm::min(other[j], other[(j + 1) % 3]) == edge.x && glm::max(other[j], other[(j + 1) % 3]) == edge.y) {
+                    ownedEdges[heir] |= (unsigned char)(1u << j);
+                }
+            }
+        }
+    }
+    ownedEdges[triangle] = 0;
+
+    // Erasing every edge as it goes would move the whole tail each time
+    if (deadEdgeCount > edges.size() / 8) {
+        compactEdges();
+    }
+}
+
+void RectClothSimulator::
+compactEdges() {
+    // Stays sorted for findEdge(); edge indices are only kept within a step
+    unsigned int kept = 0;
+    for (unsigned int e = 0; e < edges.size(); e++) {
+        if (!deadEdges[e]) {
+            edges[kept++] = edges[e];
+        }
+    }
+    edges.resize(kept);
+    deadEdges.assign(kept, 0);
+    deadEdgeCount = 0;
 }
 
 void RectClothSimulator::
 updateCloth() {
     for (unsigned int i = 0u; i < cloth->nw * cloth->nh; i++)
     {
-        cloth->setPosition(i, particles[i].position);
+        cloth->setPosition(i, positions[i]);
+    }
+}
+
+void RectClothSimulator::
+resolveSelfCollisions() {
+    const float thickness = selfCollisionThickness;
+    const int count = (int)positions.size();
+    const int nw = (int)cloth->nw;
+
+    selfCollisionHash.build(positions);
+    resizeScratch(positionCorrections, count);
+    resizeScratch(velocityCorrections, count);
+
+    // Jacobi style: every particle gathers its own correction from its neighbours, so the
+    //  pass has no write conflicts and pairs are treated symmetrically
+    unsigned int touching = 0;
+    #pragma omp parallel for schedule(dynamic, 256) reduction(+:touching)
+    for (int i = 0; i < count; i++) {
+        const glm::vec3 p = positions[i];
+        const glm::vec3 v = particles[i].velocity;
+        const int iw = i % nw, ih = i / nw;
+        glm::vec3 dp(0.0f), dv(0.0f);
+
+        selfCollisionHash.query(p, thickness, [&](unsigned int j) {
+            // Grid neighbours are held apart by springs already
+            int jw = (int)j % nw, jh = (int)j / nw;
+            if (std::abs(jw - iw) <= 1 && std::abs(jh - ih) <= 1) {
+                return;
+            }
+            glm::vec3 d = p - positions[j];
+            float d2 = glm::dot(d, d);
+            if (d2 >= thickness * thickness || d2 == 0.0f) {
+                return;
+            }
+            float length = std::sqrt(d2);
+            glm::vec3 n = d / length;
+            dp += 0.5f * (thickness - length) * n;
+
+            // Remove half of the approaching normal velocity on each side
+            float approach = glm::dot(v - particles[j].velocity, n);
+            if (approach < 0.0f) {
+                dv -= 0.5f * approach * n;
+            }
+        });
+
+        positionCorrections[i] = dp;
+        velocityCorrections[i] = dv;
+        touching += dp != glm::vec3(0.0f) ? 1u : 0u;
+    }
+    health.contacts += touching;
+
+    #pragma omp parallel for
+    for (int i = 0; i < count; i++) {
+        if (isPinned(i)) {
+            continue;
+        }
+        positions[i] += positionCorrections[i];
+        particles[i].velocity += velocityCorrections[i];
+    }
+}
+
+void RectClothSimulator::
+applyContactVelocities() {
+    // Velocity counterpart of the position response, relative to the (possibly moving)
+    //  collider: no approach into the surface, and Coulomb friction on the tangential part
+    #pragma omp parallel for
+    for (int i = 0; i < (int)particles.size(); i++) {
+        glm::vec3& velocity = particles[i].velocity;
+        for (unsigned int k = contactCache.offsets[i]; k < contactCache.offsets[i + 1]; k++) {
+            const Contact& contact = contactCache.contacts[k];
+            if (!contact.touching) {
+                continue;
+            }
+            const Collider& collider = colliders->get(contact.collider);
+            const glm::vec3 surfaceVelocity = collider.velocityAt(positions[i]);
+            float approach = glm::dot(velocity - surfaceVelocity, contact.normal);
+            if (approach < 0.0f) {
+                velocity -= approach * contact.normal;
+            }
+            glm::vec3 relative = velocity - surfaceVelocity;
+            glm::vec3 tangential = relative - glm::dot(relative, contact.normal) * contact.normal;
+            float speed = glm::length(tangential);
+            float slowdown = contact.sticking ? speed : collider.friction * glm::max(-approach, 0.0f);
+            if (speed > 0.0f) {
+                velocity -= glm::min(slowdown, speed) / speed * tangential;
+            }
+        }
+    }
+}
+
+void RectClothSimulator::
+resolveTriangleContacts() {
+    bvh.refit(positions);
+    health.contacts += colliders->resolveTriangles(positions, cloth->getTriangles(), bvh, contactCorrections);
+
+    // Same as for particles: drop the velocity into the surface
+    for (unsigned int i = 0u; i < particles.size(); i++) {
+        glm::vec3 correction(contactCorrections[i]);
+        float length = glm::length(correction);
+        if (contactCorrections[i].w == 0.0f || length == 0.0f || isPinned(i)) {
+            continue;
+        }
+        glm::vec3 normal = correction / length;
+        float approach = glm::dot(particles[i].velocity, normal);
+        if (approach < 0.0f) {
+            particles[i].velocity -= approach * normal;
+        }
+    }
+}
+
+void RectClothSimulator::
+resolveContinuousCollisions() {
+    health.contacts += colliders->sweep(previousPositions, positions, hitNormals, cloth->nw * collisionTileRows);
+
+    // Inelastic: drop the velocity into the surface
+    for (unsigned int i = 0u; i < particles.size(); i++) {
+        float approach = glm::dot(particles[i].velocity, hitNormals[i]);
+        if (approach < 0.0f) {
+            particles[i].velocity -= approach * hitNormals[i];
+        }
+    }
+}
+
+unsigned int RectClothSimulator::
+findEdge(const glm::uvec2& edge) const {
+    return (unsigned int)(std::lower_bound(edges.begin(), edges.end(), edge,
+        [](const glm::uvec2& l, const glm::uvec2& r) { return l.x < r.x || (l.x == r.x && l.y < r.y); })
+        - edges.begin());
+}
+
+void RectClothSimulator::
+findSelfImpacts(const std::vector<glm::vec3>& from, const std::vector<glm::vec3>& to, float thickness) {
+    const std::vector<glm::uvec3>& triangles = cloth->getTriangles();
+    const int count = (int)to.size();
+    const int edgeCount = (int)edges.size();
+    const float noImpact = 2.0f;
+    auto sweptBounds = [&](unsigned int v) {
+        Aabb box;
+        box.expand(from[v]);
+        box.expand(to[v]);
+        return box;
+    };
+
+    // Swept bounds: every trajectory of this step lies inside its leaf's box
+    bvh.refit(to, from, thickness);
+    bvhValid = false;
+
+    // The first continuous check can come long after the first steps
+    assignScratch(vertexImpactTimes, count, noImpact);
+    resizeScratch(vertexImpactTriangles, count);
+    assignScratch(edgeImpactTimes, edgeCount, noImpact);
+    resizeScratch(edgeImpactEdges, edgeCount);
+
+    // Detection only writes the slot of the vertex (or edge) being processed, so it is parallel
+    #pragma omp parallel for schedule(dynamic, 64)
+    for (int i = 0; i < count; i++) {
+        const Aabb box = sweptBounds(i).inflated(thickness);
+        bvh.query(box, [&](unsigned int t) {
+            const glm::uvec3 tri = triangles[t];
+            if (tri.x == (unsigned int)i || tri.y == (unsigned int)i || tri.z == (unsigned int)i) {
+                return;
+            }
+            Aabb triangleBox = sweptBounds(tri.x);
+            triangleBox.expand(sweptBounds(tri.y));
+            triangleBox.expand(sweptBounds(tri.z));
+            float toi;
+            if (triangleBox.overlaps(box) && vertexTriangleCcd(
+                    from[i], from[tri.x], from[tri.y], from[tri.z],
+                    to[i], to[tri.x], to[tri.y], to[tri.z],
+                    thickness, toi) && toi < vertexImpactTimes[i]) {
+                vertexImpactTimes[i] = toi;
+                vertexImpactTriangles[i] = t;
+            }
+        });
+    }
+
+    #pragma omp parallel for schedule(dynamic, 64)
+    for (int e = 0; e < edgeCount; e++) {
+        if (deadEdges[e]) {
+            continue;
+        }
+        const glm::uvec2 edge = edges[e];
+        Aabb box = sweptBounds(edge.x);
+        box.expand(sweptBounds(edge.y));
+        box = box.inflated(thickness);
+        bvh.query(box, [&](unsigned int t) {
+            const glm::uvec3 tri = triangles[t];
+            for (unsigned int k = 0; k < 3; k++) {
+                glm::uvec2 other(glm::min(tri[k], tri[(k + 1) % 3]), glm::max(tri[k], tri[(k + 1) % 3]));
+                // Each pair once, and never edges that share a vertex
+                if (!(ownedEdges[t] & (1u << k)) || other.x < edge.x || other.x == edge.x || other.x == edge.y || other.y == edge.x || other.y == edge.y) {
+                    continue;
+                }
+                Aabb otherBox = sweptBounds(other.x);
+                otherBox.expand(sweptBounds(other.y));
+                float toi;
+                if (otherBox.overlaps(box) && edgeEdgeCcd(
+                        from[edge.x], from[edge.y], from[other.x], from[other.y],
+                        to[edge.x], to[edge.y], to[other.x], to[other.y],
+                        thickness, toi) && toi < edgeImpactTimes[e]) {
+                    edgeImpactTimes[e] = toi;
+                    edgeImpactEdges[e] = findEdge(other);
+                }
+            }
+        });
+    }
+}
+
+void RectClothSimulator::
+resolveContinuousSelfCollisions(float timeStep) {
+    const std::vector<glm::uvec3>& triangles = cloth->getTriangles();
+    const int count = (int)positions.size();
+    const int edgeCount = (int)edges.size();
+    const float noImpact = 2.0f;
+
+    findSelfImpacts(previousPositions, positions, ccdThickness);
+
+    // Every impact's impulse is computed from the same velocities and gathered per vertex
+    //  (xyz in impulseCorrections, the matching displacement in positionCorrections), then
+    //  applied once, so a vertex in several impacts takes their average and keeps the
+    //  collider and self-collision projections of this step
+    assignScratch(impulseCorrections, count, glm::vec4(0.0f));
+    assignScratch(positionCorrections, count, glm::vec3(0.0f));
+    for (int i = 0; i < count; i++) {
+        if (vertexImpactTimes[i] >= noImpact) {
+            continue;
+        }
+        const float toi = vertexImpactTimes[i];
+        const glm::uvec3 tri = triangles[vertexImpactTriangles[i]];
+        unsigned int involved[4] = {(unsigned int)i, tri.x, tri.y, tri.z};
+        glm::vec3 at[4];
+        for (int k = 0; k < 4; k++) {
+            at[k] = glm::mix(previousPositions[involved[k]], positions[involved[k]], toi);
+        }
+        glm::vec3 barycentric;
+        closestPointOnTriangle(at[0], at[1], at[2], at[3], barycentric);
+        float weights[4] = {1.0f, -barycentric.x, -barycentric.y, -barycentric.z};
+
+        // Triangle normal, facing the side the vertex started on
+        glm::vec3 normal = glm::cross(at[2] - at[1], at[3] - at[1]);
+        glm::vec3 before = previousPositions[i] - (barycentric.x * previousPositions[tri.x]
+            + barycentric.y * previousPositions[tri.y] + barycentric.z * previousPositions[tri.z]);
+        if (glm::dot(normal, before) < 0.0f) {
+            normal = -normal;
+        }
+        applyImpulse(involved, weights, normal, (1.0f - toi) * timeStep);
+        health.contacts++;
+    }
+    for (int e = 0; e < edgeCount; e++) {
+        if (edgeImpactTimes[e] >= noImpact) {
+            continue;
+        }
+        const float toi = edgeImpactTimes[e];
+        const glm::uvec2 other = edges[edgeImpactEdges[e]];
+        unsigned int involved[4] = {edges[e].x, edges[e].y, other.x, other.y};
+        glm::vec3 at[4];
+        for (int k = 0; k < 4; k++) {
+            at[k] = glm::mix(previousPositions[involved[k]], positions[involved[k]], toi);
+        }
+        float s, u;
+        segmentSegmentDistance(at[0], at[1], at[2], at[3], s, u);
+        float weights[4] = {1.0f - s, s, u - 1.0f, -u};
+
+        glm::vec3 normal = glm::cross(at[1] - at[0], at[3] - at[2]);
+        glm::vec3 before = glm::mix(previousPositions[involved[0]], previousPositions[involved[1]], s)
+            - glm::mix(previousPositions[involved[2]], previousPositions[involved[3]], u);
+        if (glm::dot(normal, normal) < 1e-12f) {
+            normal = before; // parallel edges
+        }
+        if (glm::dot(normal, before) < 0.0f) {
+            normal = -normal;
+        }
+        applyImpulse(involved, weights, normal, (1.0f - toi) * timeStep);
+        health.contacts++;
+    }
+
+    #pragma omp parallel for
+    for (int i = 0; i < count; i++) {
+        const float impacts = impulseCorrections[i].w;
+        if (impacts == 0.0f) {
+            continue;
+        }
+        particles[i].velocity += glm::vec3(impulseCorrections[i]) / impacts;
+        positions[i] += positionCorrections[i] / impacts;
+    }
+}
+
+void RectClothSimulator::
+applyImpulse(const unsigned int* vertices, const float* weights, glm::vec3 normal, float remaining) {
+    // Inelastic impulse on the relative velocity sum(w_k v_k) along the normal, gathered
+    //  for resolveContinuousSelfCollisions(). Pinned vertices have infinite mass and take none of it.
+    float length = glm::length(normal);
+    if (length < 1e-12f) {
+        return;
+    }
+    normal /= length;
+
+    float approach = 0.0f, inverseMass = 0.0f;
+    for (int k = 0; k < 4; k++) {
+        approach += weights[k] * glm::dot(particles[vertices[k]].velocity, normal);
+        if (!isPinned(vertices[k])) {
+            inverseMass += weights[k] * weights[k] / particles[vertices[k]].mass;
+        }
+    }
+    if (approach >= 0.0f || inverseMass <= 0.0f) {
+        return;
+    }
+    float impulse = -approach / inverseMass;
+
+    // The new velocity only acts for the time left after the impact
+    for (int k = 0; k < 4; k++) {
+        unsigned int v = vertices[k];
+        if (isPinned(v)) {
+            continue;
+        }
+        glm::vec3 dv = weights[k] * impulse / particles[v].mass * normal;
+        impulseCorrections[v] += glm::vec4(dv, 1.0f);
+        positionCorrections[v] += remaining * dv;
+    }
+}
+
+void RectClothSimulator::
+beginClothContacts() {
+    assignScratch(clothPositionCorrections, positions.size(), glm::vec4(0.0f));
+    assignScratch(clothVelocityCorrections, positions.size(), glm::vec3(0.0f));
+}
+
+void RectClothSimulator::
+collideWith(RectClothSimulator& other, float thickness) {
+    const std::vector<glm::uvec3>& triangles = other.cloth->getTriangles();
+    const ClothBvh& otherBvh = other.getBvh();
+    const Aabb reach = otherBvh.bounds().inflated(thickness);
+
+    // Both sides move, by inverse mass; corrections are gathered Jacobi style and applied in endClothContacts()
+    #pragma omp parallel for schedule(dynamic, 64)
+    for (int i = 0; i < (int)positions.size(); i++) {
+        const glm::vec3 p = positions[i];
+        if (!reach.contains(p)) {
+            continue;
+        }
+        const float inverseMass = isPinned(i) ? 0.0f : 1.0f / particles[i].mass;
+        otherBvh.query(Aabb(p, p).inflated(thickness), [&](unsigned int t) {
+            const glm::uvec3 tri = triangles[t];
+            const glm::vec3 a = other.positions[tri.x], b = other.positions[tri.y], c = other.positions[tri.z];
+            glm::vec3 barycentric;
+            glm::vec3 d = p - closestPointOnTriangle(p, a, b, c, barycentric);
+            float length = glm::length(d);
+            if (length >= thickness) {
+                return;
+            }
+            glm::vec3 normal = length > 1e-7f ? d / length : glm::normalize(glm::cross(b - a, c - a));
+
+            float weights[3] = {barycentric.x, barycentric.y, barycentric.z};
+            float otherInverseMasses[3];
+            float total = inverseMass;
+            for (int k = 0; k < 3; k++) {
+                otherInverseMasses[k] = other.isPinned(tri[k]) ? 0.0f : 1.0f / other.particles[tri[k]].mass;
+                total += weights[k] * weights[k] * otherInverseMasses[k];
+            }
+            if (total <= 0.0f) {
+                return;
+            }
+            float push = (thickness - length) / total;
+
+            glm::vec3 otherVelocity = barycentric.x * other.particles[tri.x].velocity
+                + barycentric.y * other.particles[tri.y].velocity + barycentric.z * other.particles[tri.z].velocity;
+            float approach = glm::dot(particles[i].velocity - otherVelocity, normal);
+            float impulse = approach < 0.0f ? -approach / total : 0.0f;
+
+            glm::vec4 move(inverseMass * push * normal, 1.0f);
+            glm::vec3 kick = inverseMass * impulse * normal;
+            #pragma omp atomic
+            clothPositionCorrections[i].x += move.x;
+            #pragma omp atomic
+            clothPositionCorrections[i].y += move.y;
+            #pragma omp atomic
+            clothPositionCorrections[i].z += move.z;
+            #pragma omp atomic
+            clothPositionCorrections[i].w += move.w;
+            #pragma omp atomic
+            clothVelocityCorrections[i].x += kick.x;
+            #pragma omp atomic
+            clothVelocityCorrections[i].y += kick.y;
+            #pragma omp atomic
+            clothVelocityCorrections[i].z += kick.z;
+            for (int k = 0; k < 3; k++) {
+                glm::vec4& otherMove = other.clothPositionCorrections[tri[k]];
+                glm::vec3& otherKick = other.clothVelocityCorrections[tri[k]];
+                glm::vec3 m = -weights[k] * otherInverseMasses[k] * push * normal;
+                glm::vec3 v = -weights[k] * otherInverseMasses[k] * impulse * normal;
+                #pragma omp atomic
+                otherMove.x += m.x;
+                #pragma omp atomic
+                otherMove.y += m.y;
+                #pragma omp atomic
+                otherMove.z += m.z;
+                #pragma omp atomic
+                otherMove.w += 1.0f;
+                #pragma omp atomic
+                otherKick.x += v.x;
+                #pragma omp atomic
+                otherKick.y += v.y;
+                #pragma omp atomic
+                otherKick.z += v.z;
+            }
+        });
+    }
+}
+
+void RectClothSimulator::
+endClothContacts() {
+    // finishStep() hands the positions to the cloth afterwards
+    unsigned int touching = 0;
+    for (unsigned int i = 0u; i < positions.size(); i++) {
+        float count = clothPositionCorrections[i].w;
+        if (count > 0.0f) {
+            positions[i] += glm::vec3(clothPositionCorrections[i]) / count;
+            particles[i].velocity += clothVelocityCorrections[i] / count;
+            touching++;
+        }
+    }
+    health.contacts += touching;
+    bvhValid = bvhValid && touching == 0;
+}
+
+// Log barrier b(d) = -(d - dhat)^2 ln(d / dhat) for 0 < d < dhat, and its derivatives.
+//  It is C2 at dhat and grows without bound as d goes to zero.
+static float barrier(float d, float dhat) {
+    if (d <= 0.0f) {
+        return std::numeric_limits<float>::infinity();
+    }
+    return d >= dhat ? 0.0f : -(d - dhat) * (d - dhat) * std::log(d / dhat);
+}
+
+static float barrierDerivative(float d, float dhat) {
+    return d >= dhat ? 0.0f : -2.0f * (d - dhat) * std::log(d / dhat) - (d - dhat) * (d - dhat) / d;
+}
+
+static float barrierSecondDerivative(float d, float dhat) {
+    return d >= dhat ? 0.0f : -2.0f * std::log(d / dhat) - 4.0f * (d - dhat) / d + (d - dhat) * (d - dhat) / (d * d);
+}
+
+void RectClothSimulator::
+stepBarrier(float timeStep) {
+    // Backward Euler as a minimization (incremental potential contact):
+    //  E(x) = 1/2 |x - x^|_M^2 + h^2 (springs(x) + kappa sum b(d_k(x))), x^ = x + h v + h^2 a
+    //  solved by Newton with a matrix-free CG, and a line search that continuous collision
+    //  detection keeps short of every first contact, so the barriers never get crossed.
+    const int count = (int)positions.size();
+    const float h = timeStep;
+
+    previousPositions = positions;
+    resizeScratch(inertiaTargets, count);
+    unsigned int pinned = 0;
+    #pragma omp parallel for reduction(+:pinned)
+    for (int i = 0; i < count; i++) {
+        MassParticle& particle = particles[i];
+        if (isPinned(i)) {
+            pinned++;
+            inertiaTargets[i] = positions[i];
+            particle.force = glm::vec3(0.0f);
+            continue;
+        }
+        glm::vec3 force = particle.force + gravity * particle.mass;
+        if (!is_aerodynamic && particle.velocity != glm::vec3(0.0f)) {
+            force -= airResistanceCoefficient * glm::dot(particle.velocity, particle.velocity) * glm::normalize(particle.velocity);
+        }
+        inertiaTargets[i] = positions[i] + h * particle.velocity + h * h / particle.mass * force;
+        particle.force = glm::vec3(0.0f);
+    }
+
+    // Colliders are at their end of step pose; a particle one moved into starts on its surface,
+    //  unless it is pinned
+    const bool withColliders = is_collision && colliders;
+    colliderBoxes.clear();
+    if (withColliders) {
+        for (unsigned int c = 0; c < colliders->size(); c++) {
+            pushScratch(colliderBoxes, colliders->get(c).bounds());
+        }
+        #pragma omp parallel for
+        for (int i = 0; i < count; i++) {
+            if (isPinned(i)) {
+                continue;
+            }
+            for (unsigned int c = 0; c < colliderBoxes.size(); c++) {
+                if (colliderBoxes[c].distanceTo(positions[i]) >= barrierDistance) {
+                    continue;
+                }
+                glm::vec3 normal;
+                float d = colliders->get(c).distance(positions[i], normal);
+                if (d < 0.1f * barrierDistance) {
+                    positions[i] += (0.1f * barrierDistance - d) * normal;
+                }
+            }
+        }
+    }
+
+    double energy = barrierEnergy(positions, h);
+    // Converged once the remaining step changes no velocity by more than a hundredth of dx per second
+    const float tolerance = 1e-2f * cloth->dx * h;
+    health.pinned = pinned;
+    for (unsigned int iteration = 0; iteration < maxNewtonIterations; iteration++) {
+        computeNewtonSystem(h);
+        health.cgIterations += solveNewtonDirection(h);
+        health.newtonIterations++;
+
+        float longest = 0.0f;
+        #pragma omp parallel for reduction(max:longest)
+        for (int i = 0; i < count; i++) {
+            longest = glm::max(longest, glm::length(newtonDirection[i]));
+        }
+        health.newtonResidual = longest / tolerance;
+        if (longest < tolerance) {
+            break;
+        }
+
+        // Backtrack from the largest intersection free step until the energy decreases
+        float alpha = barrierStepBound(longest);
+        double trialEnergy = 0.0;
+        resizeScratch(trialPositions, count);
+        bool accepted = false;
+        for (; alpha * longest >= 1e-2f * tolerance; alpha *= 0.5f) {
+            #pragma omp parallel for
+            for (int i = 0; i < count; i++) {
+                trialPositions[i] = positions[i] + alpha * newtonDirection[i];
+            }
+            trialEnergy = barrierEnergy(trialPositions, h);
+            if (trialEnergy <= energy) {
+                accepted = true;
+                break;
+            }
+        }
+        if (!accepted) {
+            barrierEnergy(positions, h); // contacts back at the iterate
+            break;
+        }
+        positions.swap(trialPositions);
+        energy = trialEnergy;
+    }
+
+    double kinetic = 0.0;
+    #pragma omp parallel for reduction(+:kinetic)
+    for (int i = 0; i < count; i++) {
+        particles[i].velocity = (positions[i] - previousPositions[i]) / h;
+        kinetic += 0.5 * particles[i].mass * glm::dot(particles[i].velocity, particles[i].velocity);
+    }
+    health.kineticEnergy = kinetic;
+    health.contacts = (unsigned int)barrierContacts.size();
+    if (withColliders) {
+        applyBarrierFriction(h);
+    }
+}
+
+void RectClothSimulator::
+gatherBarrierContacts(const std::vector<glm::vec3>& x) {
+    const std::vector<glm::uvec3>& triangles = cloth->getTriangles();
+    const unsigned int nw = cloth->nw, nh = cloth->nh;
+    const float dhat = barrierDistance;
+    const bool withColliders = is_collision && colliders;
+    const bool withSelf = is_self_collision;
+
+    if (withSelf) {
+        bvh.refit(x, dhat);
+        bvhValid = false;
+    }
+    resizeScratch(barrierTileContacts, nh);
+
+    // One row of vertices, and the edges starting in it, per tile
+    #pragma omp parallel for schedule(dynamic, 1)
+    for (int row = 0; row < (int)nh; row++) {
+        std::vector<BarrierContact>& tile = barrierTileContacts[row];
+        tile.clear();
+        for (unsigned int i = row * nw; i < (row + 1) * nw; i++) {
+            const glm::vec3 p = x[i];
+            for (unsigned int c = 0; withColliders && c < colliderBoxes.size(); c++) {
+                if (colliderBoxes[c].distanceTo(p) >= dhat) {
+                    continue;
+                }
+                glm::vec3 normal;
+                float d = colliders->get(c).distance(p, normal);
+                if (d < dhat) {
+                    pushScratch(tile, {{i, i, i, i}, {1.0f, 0.0f, 0.0f, 0.0f}, normal, d, (int)c});
+                }
+            }
+            if (!withSelf) {
+                continue;
+            }
+            bvh.query(Aabb(p, p).inflated(dhat), [&](unsigned int t) {
+                const glm::uvec3 tri = triangles[t];
+                if (tri.x == i || tri.y == i || tri.z == i) {
+                    return;
+                }
+                Aabb triangleBox;
+                triangleBox.expand(x[tri.x]);
+                triangleBox.expand(x[tri.y]);
+                triangleBox.expand(x[tri.z]);
+                if (triangleBox.distanceTo(p) >= dhat) {
+                    return;
+                }
+                glm::vec3 barycentric;
+                glm::vec3 offset = p - closestPointOnTriangle(p, x[tri.x], x[tri.y], x[tri.z], barycentric);
+                float d = glm::length(offset);
+                if (d < dhat) {
+                    pushScratch(tile, {{i, tri.x, tri.y, tri.z}, {1.0f, -barycentric.x, -barycentric.y, -barycentric.z},
+                                 d > 0.0f ? offset / d : glm::vec3(0.0f), d, -1});
+                }
+            });
+        }
+        if (!withSelf) {
+            continue;
+        }
+
+        unsigned int first = findEdge(glm::uvec2(row * nw, 0u)), last = findEdge(glm::uvec2((row + 1) * nw, 0u));
+        for (unsigned int e = first; e < last; e++) {
+            if (deadEdges[e]) {
+                continue;
+            }
+            const glm::uvec2 edge = edges[e];
+            Aabb box;
+            box.expand(x[edge.x]);
+            box.expand(x[edge.y]);
+            box = box.inflated(dhat);
+            bvh.query(box, [&](unsigned int t) {
+                const glm::uvec3 tri = triangles[t];
+                for (unsigned int k = 0; k < 3; k++) {
+                    glm::uvec2 other(glm::min(tri[k], tri[(k + 1) % 3]), glm::max(tri[k], tri[(k + 1) % 3]));
+                    if (!(ownedEdges[t] & (1u << k)) || other.x < edge.x || other.x == edge.x || other.x == edge.y
+                        || other.y == edge.x || other.y == edge.y) {
+                        continue;
+                    }
+                    Aabb otherBox;
+                    otherBox.expand(x[other.x]);
+                    otherBox.expand(x[other.y]);
+                    if (!otherBox.overlaps(box)) {
+                        continue;
+                    }
+                    float s, u;
+                    float d = segmentSegmentDistance(x[edge.x], x[edge.y], x[other.x], x[other.y], s, u);
+                    if (d >= dhat) {
+                        continue;
+                    }
+                    glm::vec3 offset = glm::mix(x[edge.x], x[edge.y], s) - glm::mix(x[other.x], x[other.y], u);
+                    pushScratch(tile, {{edge.x, edge.y, other.x, other.y}, {1.0f - s, s, u - 1.0f, -u},
+                                 d > 0.0f ? offset / d : glm::vec3(0.0f), d, -1});
+                }
+            });
+        }
+    }
+
+    // The lists keep their capacity, they only grow when the scene reaches more contacts than ever
+    size_t total = 0;
+    for (const std::vector<BarrierContact>& tile : barrierTileContacts) {
+        total += tile.size();
+    }
+    if (total > barrierContacts.capacity()) {
+        expectAllocation();
+        barrierContacts.reserve(std::max(total, 2 * barrierContacts.capacity()));
+    }
+    barrierContacts.clear();
+    for (const std::vector<BarrierContact>& tile : barrierTileContacts) {
+        barrierContacts.insert(barrierContacts.end(), tile.begin(), tile.end());
+    }
+}
+
+double RectClothSimulator::
+barrierEnergy(const std::vector<glm::vec3>& x, float timeStep) {
+    gatherBarrierContacts(x);
+
+    const float h2 = timeStep * timeStep;
+    double inertia = 0.0, elastic = 0.0, contact = 0.0;
+    float maxStrain = 0.0f, strainSum = 0.0f;
+    #pragma omp parallel for reduction(+:inertia)
+    for (int i = 0; i < (int)x.size(); i++) {
+        glm::vec3 d = x[i] - inertiaTargets[i];
+        inertia += 0.5 * particles[i].mass * glm::dot(d, d);
+    }
+    #pragma omp parallel for reduction(+:elastic, strainSum) reduction(max:maxStrain)
+    for (int s = 0; s < (int)springs.size(); s++) {
+        const Spring& spring = springs[s];
+        float stretch = glm::length(x[spring.toMassIndex] - x[spring.fromMassIndex]) - spring.restLength;
+        elastic += 0.5 * spring.stiffness * stretch * stretch;
+        maxStrain = glm::max(maxStrain, std::abs(stretch) / spring.restLength);
+        strainSum += std::abs(stretch) / spring.restLength;
+    }
+    // The last evaluation of a step is at its final positions
+    health.maxStrain = maxStrain;
+    health.meanStrain = springs.empty() ? 0.0f : strainSum / (float)springs.size();
+    #pragma omp parallel for reduction(+:contact)
+    for (int k = 0; k < (int)barrierContacts.size(); k++) {
+        contact += barrierStiffness * barrier(barrierContacts[k].distance, barrierDistance);
+    }
+    return inertia + h2 * (elastic + contact);
+}
+
+void RectClothSimulator::
+computeNewtonSystem(float timeStep) {
+    // Gradient, spring Hessians (projected to be positive semi-definite) and the block
+    //  diagonal preconditioner, at the current iterate and its gathered contacts
+    const int count = (int)positions.size();
+    const float h2 = timeStep * timeStep;
+
+    resizeScratch(springHessians, springs.size());
+    #pragma omp parallel for
+    for (int s = 0; s < (int)springs.size(); s++) {
+        const Spring& spring = springs[s];
+        glm::vec3 d = positions[spring.toMassIndex] - positions[spring.fromMassIndex];
+        float length = glm::length(d);
+        glm::vec3 n = d / length;
+        glm::mat3 nn = glm::outerProduct(n, n);
+        float transverse = glm::max(1.0f - spring.restLength / length, 0.0f);
+        springHessians[s] = spring.stiffness * (nn + transverse * (glm::mat3(1.0f) - nn));
+    }
+
+    resizeScratch(newtonGradient, count);
+    resizeScratch(blockPreconditioner, count);
+    #pragma omp parallel for
+    for (int i = 0; i < count; i++) {
+        const MassParticle& particle = particles[i];
+        glm::vec3 gradient = particle.mass * (positions[i] - inertiaTargets[i]);
+        glm::mat3 diagonal(0.0f);
+        // Springs are stored in both directions, each copy adds its energy
+        for (unsigned int s : particle.connectedSpringStartIndices) {
+            glm::vec3 d = positions[springs[s].toMassIndex] - positions[i];
+            float length = glm::length(d);
+            gradient -= h2 * springs[s].stiffness * (length - springs[s].restLength) / length * d;
+            diagonal += springHessians[s];
+        }
+        for (unsigned int s : particle.connectedSpringEndIndices) {
+            glm::vec3 d = positions[i] - positions[springs[s].fromMassIndex];
+            float length = glm::length(d);
+            gradient += h2 * springs[s].stiffness * (length - springs[s].restLength) / length * d;
+            diagonal += springHessians[s];
+        }
+        newtonGradient[i] = gradient;
+        blockPreconditioner[i] = glm::mat3(particle.mass) + h2 * diagonal;
+    }
+
+    // Contacts, by their weights on the shared normal; Gauss-Newton for the Hessian
+    for (const BarrierContact& contact : barrierContacts) {
+        float slope = h2 * barrierStiffness * barrierDerivative(contact.distance, barrierDistance);
+        float curvature = h2 * barrierStiffness * barrierSecondDerivative(contact.distance, barrierDistance);
+        glm::mat3 nn = glm::outerProduct(contact.normal, contact.normal);
+        for (int k = 0; k < 4; k++) {
+            unsigned int v = contact.vertices[k];
+            newtonGradient[v] += slope * contact.weights[k] * contact.normal;
+            blockPreconditioner[v] += curvature * contact.weights[k] * contact.weights[k] * nn;
+        }
+    }
+
+    #pragma omp parallel for
+    for (int i = 0; i < count; i++) {
+        if (isPinned(i)) {
+            newtonGradient[i] = glm::vec3(0.0f);
+            blockPreconditioner[i] = glm::mat3(0.0f);
+        } else {
+            blockPreconditioner[i] = glm::inverse(blockPreconditioner[i]);
+        }
+    }
+}
+
+void RectClothSimulator::
+multiplyHessian(const std::vector<glm::vec3>& v, std::vector<glm::vec3>& out, float timeStep) {
+    const int count = (int)positions.size();
+    const float h2 = timeStep * timeStep;
+
+    #pragma omp parallel for
+    for (int i = 0; i < count; i++) {
+        const MassParticle& particle = particles[i];
+        glm::vec3 result = particle.mass * v[i];
+        for (unsigned int s : particle.connectedSpringStartIndices) {
+            result -= h2 * (springHessians[s] * (v[springs[s].toMassIndex] - v[i]));
+        }
+        for (unsigned int s : particle.connectedSpringEndIndices) {
+            result += h2 * (springHessians[s] * (v[i] - v[springs[s].fromMassIndex]));
+        }
+        out[i] = result;
     }
-}
\ No newline at end of file
+
+    #pragma omp parallel for
+    for (int k = 0; k < (int)barrierContacts.size(); k++) {
+        const BarrierContact& contact = barrierContacts[k];
+        float along = 0.0f;
+        for (int j = 0; j < 4; j++) {
+            along += contact.weights[j] * glm::dot(contact.normal, v[contact.vertices[j]]);
+        }
+        float scale = h2 * barrierStiffness * barrierSecondDerivative(contact.distance, barrierDistance) * along;
+        for (int j = 0; j < 4; j++) {
+            glm::vec3 add = scale * contact.weights[j] * contact.normal;
+            glm::vec3& target = out[contact.vertices[j]];
+            #pragma omp atomic
+            target.x += add.x;
+            #pragma omp atomic
+            target.y += add.y;
+            #pragma omp atomic
+            target.z += add.z;
+        }
+    }
+
+    // Pinned particles are fixed, their rows and columns drop out
+    #pragma omp parallel for
+    for (int i = 0; i < count; i++) {
+        if (isPinned(i)) {
+            out[i] = glm::vec3(0.0f);
+        }
+    }
+}
+
+unsigned int RectClothSimulator::
+solveNewtonDirection(float timeStep) {
+    // Preconditioned conjugate gradients on H p = -g, from p = 0
+    const int count = (int)positions.size();
+    assignScratch(newtonDirection, count, glm::vec3(0.0f));
+    resizeScratch(cgResidual, count);
+    resizeScratch(cgPreconditioned, count);
+    resizeScratch(cgSearch, count);
+    resizeScratch(cgProduct, count);
+
+    double rz = 0.0, initial = 0.0;
+    #pragma omp parallel for reduction(+:rz, initial)
+    for (int i = 0; i < count; i++) {
+        cgResidual[i] = -newtonGradient[i];
+        cgPreconditioned[i] = blockPreconditioner[i] * cgResidual[i];
+        cgSearch[i] = cgPreconditioned[i];
+        rz += glm::dot(cgResidual[i], cgPreconditioned[i]);
+        initial += glm::dot(cgResidual[i], cgResidual[i]);
+    }
+    const double target = 1e-8 * initial;
+
+    unsigned int iteration = 0;
+    for (; iteration < maxCgIterations && rz > 0.0; iteration++) {
+        multiplyHessian(cgSearch, cgProduct, timeStep);
+        double curvature = 0.0;
+        #pragma omp parallel for reduction(+:curvature)
+        for (int i = 0; i < count; i++) {
+            curvature += glm::dot(cgSearch[i], cgProduct[i]);
+        }
+        if (curvature <= 0.0) {
+            break;
+        }
+        const float alpha = (float)(rz / curvature);
+        double nextRz = 0.0, residual = 0.0;
+        #pragma omp parallel for reduction(+:nextRz, residual)
+        for (int i = 0; i < count; i++) {
+            newtonDirection[i] += alpha * cgSearch[i];
+            cgResidual[i] -= alpha * cgProduct[i];
+            cgPreconditioned[i] = blockPreconditioner[i] * cgResidual[i];
+            nextRz += glm::dot(cgResidual[i], cgPreconditioned[i]);
+            residual += glm::dot(cgResidual[i], cgResidual[i]);
+        }
+        if (residual <= target) {
+            iteration++;
+            break;
+        }
+        const float beta = (float)(nextRz / rz);
+        rz = nextRz;
+        #pragma omp parallel for
+        for (int i = 0; i < count; i++) {
+            cgSearch[i] = cgPreconditioned[i] + beta * cgSearch[i];
+        }
+    }
+    return iteration;
+}
+
+float RectClothSimulator::
+barrierStepBound(float longest) {
+    // Fraction of the Newton step that stays clear of every first contact, with some room
+    const int count = (int)positions.size();
+    resizeScratch(trialPositions, count);
+    #pragma omp parallel for
+    for (int i = 0; i < count; i++) {
+        trialPositions[i] = positions[i] + newtonDirection[i];
+    }
+
+    // Pairs further apart than their largest relative motion cannot meet: self pairs move by
+    //  up to twice the longest step, colliders hold still within the step, and pairs that
+    //  are not in contact are at least the barrier distance apart
+    float gap = is_self_collision ? 0.5f * barrierDistance : barrierDistance;
+    for (const BarrierContact& contact : barrierContacts) {
+        gap = glm::min(gap, contact.collider < 0 ? 0.5f * contact.distance : contact.distance);
+    }
+    if (longest < gap) {
+        return 1.0f;
+    }
+
+    float bound = 1.0f;
+    if (is_self_collision) {
+        findSelfImpacts(positions, trialPositions, 1e-3f * barrierDistance);
+        #pragma omp parallel for reduction(min:bound)
+        for (int i = 0; i < count; i++) {
+            bound = glm::min(bound, vertexImpactTimes[i]);
+        }
+        #pragma omp parallel for reduction(min:bound)
+        for (int e = 0; e < (int)edges.size(); e++) {
+            bound = glm::min(bound, edgeImpactTimes[e]);
+        }
+    }
+    if (is_collision && colliders) {
+        #pragma omp parallel for reduction(min:bound)
+        for (int i = 0; i < count; i++) {
+            Aabb path;
+            path.expand(positions[i]);
+            path.expand(trialPositions[i]);
+            for (unsigned int c = 0; c < colliderBoxes.size(); c++) {
+                float toi;
+                glm::vec3 normal;
+                if (colliderBoxes[c].overlaps(path) && colliders->get(c).sweep(positions[i], trialPositions[i], toi, normal)) {
+                    bound = glm::min(bound, toi);
+                }
+            }
+        }
+    }
+    return bound < 1.0f ? 0.8f * bound : 1.0f;
+}
+
+void RectClothSimulator::
+applyBarrierFriction(float timeStep) {
+    // Coulomb friction from the barrier's normal force, lagged to the end of the step
+    for (const BarrierContact& contact : barrierContacts) {
+        if (contact.collider < 0) {
+            continue;
+        }
+        unsigned int i = contact.vertices[0];
+        if (isPinned(i)) {
+            continue;
+        }
+        const Collider& collider = colliders->get((unsigned int)contact.collider);
+        float normalForce = -barrierStiffness * barrierDerivative(contact.distance, barrierDistance);
+        glm::vec3& velocity = particles[i].velocity;
+        glm::vec3 relative = velocity - collider.velocityAt(positions[i]);
+        glm::vec3 tangential = relative - glm::dot(relative, contact.normal) * contact.normal;
+        float speed = glm::length(tangential);
+        float slowdown = collider.friction * normalForce * timeStep / particles[i].mass;
+        if (speed > 0.0f) {
+            velocity -= glm::min(slowdown, speed) / speed * tangential;
+        }
+    }
+}
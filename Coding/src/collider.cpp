@@ -0,0 +1,810 @@
+#include "collider.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "allocation_tracker.hpp"
+#include "ccd.hpp"
+#include "geometry.hpp"
+
+static const float unbounded = 1e30f;
+
+Aabb Collider::
+bounds() const {
+    switch (type) {
+    case ColliderType::Sphere:
+        return Aabb(center - radius, center + radius);
+    case ColliderType::Capsule:
+        return Aabb(glm::min(center, axis) - radius, glm::max(center, axis) + radius);
+    case ColliderType::Box: {
+        glm::mat3 absRotation(glm::abs(rotation[0]), glm::abs(rotation[1]), glm::abs(rotation[2]));
+        glm::vec3 extent = absRotation * halfExtents;
+        return Aabb(center - extent, center + extent);
+    }
+    case ColliderType::Heightfield: {
+        // Everything below the surface counts as inside
+        float top = heights.empty() ? center.y : *std::max_element(heights.begin(), heights.end());
+        glm::vec3 far = center + glm::vec3((float)(nx - 1) * spacing, 0.0f, (float)(nz - 1) * spacing);
+        return Aabb(glm::vec3(center.x, -unbounded, center.z), glm::vec3(far.x, top, far.z));
+    }
+    case ColliderType::Sdf: {
+        Aabb local = field->bounds();
+        glm::vec3 localCenter = 0.5f * (local.min + local.max);
+        glm::mat3 absRotation(glm::abs(rotation[0]), glm::abs(rotation[1]), glm::abs(rotation[2]));
+        glm::vec3 extent = absRotation * (0.5f * (local.max - local.min)) + radius;
+        glm::vec3 worldCenter = center + rotation * localCenter;
+        return Aabb(worldCenter - extent, worldCenter + extent);
+    }
+    case ColliderType::Plane:
+    default:
+        return Aabb(glm::vec3(-unbounded), glm::vec3(unbounded));
+    }
+}
+
+void Collider::
+advance(float timeStep) {
+    const glm::vec3 move = velocity * timeStep;
+    const float angle = glm::length(angularVelocity) * timeStep;
+    if (type == ColliderType::Heightfield || angle <= 0.0f) {
+        center += move;
+        if (type == ColliderType::Capsule) {
+            axis += move;
+        }
+        return;
+    }
+
+    const glm::mat3 turn(glm::rotate(glm::mat4(1.0f), angle, glm::normalize(angularVelocity)));
+    const glm::vec3 origin = pivot();
+    rotation = turn * rotation;
+    switch (type) {
+    case ColliderType::Capsule:
+        center = origin + move + turn * (center - origin);
+        axis = origin + move + turn * (axis - origin);
+        break;
+    case ColliderType::Plane:
+        axis = glm::normalize(turn * axis);
+        center += move;
+        break;
+    default:
+        center += move;
+        break;
+    }
+}
+
+float Collider::
+heightAt(float x, float z) const {
+    float u = glm::clamp((x - center.x) / spacing, 0.0f, (float)(nx - 1));
+    float v = glm::clamp((z - center.z) / spacing, 0.0f, (float)(nz - 1));
+    unsigned int i = std::min((unsigned int)u, nx - 2);
+    unsigned int j = std::min((unsigned int)v, nz - 2);
+    float s = u - (float)i, t = v - (float)j;
+    float h0 = glm::mix(heights[j * nx + i], heights[j * nx + i + 1], s);
+    float h1 = glm::mix(heights[(j + 1) * nx + i], heights[(j + 1) * nx + i + 1], s);
+    return center.y + glm::mix(h0, h1, t);
+}
+
+float Collider::
+distance(const glm::vec3& p, glm::vec3& normal) const {
+    float d;
+    distances(&p.x, &p.y, &p.z, 1, &d, &normal.x, &normal.y, &normal.z);
+    return d;
+}
+
+void Collider::
+distances(const float* x, const float* y, const float* z, int count,
+          float* out, float* normalX, float* normalY, float* normalZ) const {
+    // One branch-free loop per analytic shape over plain floats, with the shape copied to
+    //  locals, so that each can be vectorised; conditions only pick between constants
+    const float cx = center.x, cy = center.y, cz = center.z;
+    switch (type) {
+    case ColliderType::Sphere: {
+        const float r = radius;
+        #pragma omp simd
+        for (int i = 0; i < count; i++) {
+            float dx = x[i] - cx, dy = y[i] - cy, dz = z[i] - cz;
+            float length = std::sqrt(dx * dx + dy * dy + dz * dz);
+            float inverse = 1.0f / (length + 1e-30f);
+            out[i] = length - r;
+            normalX[i] = dx * inverse;
+            normalY[i] = dy * inverse + (length > 0.0f ? 0.0f : 1.0f);
+            normalZ[i] = dz * inverse;
+        }
+        break;
+    }
+    case ColliderType::Plane: {
+        const float ax = axis.x, ay = axis.y, az = axis.z;
+        #pragma omp simd
+        for (int i = 0; i < count; i++) {
+            out[i] = (x[i] - cx) * ax + (y[i] - cy) * ay + (z[i] - cz) * az;
+            normalX[i] = ax;
+            normalY[i] = ay;
+            normalZ[i] = az;
+        }
+        break;
+    }
+    case ColliderType::Capsule: {
+        const float abx = axis.x - cx, aby = axis.y - cy, abz = axis.z - cz;
+        const float invAb2 = 1.0f / std::max(abx * abx + aby * aby + abz * abz, 1e-12f);
+        const float r = radius;
+        #pragma omp simd
+        for (int i = 0; i < count; i++) {
+            float px = x[i] - cx, py = y[i] - cy, pz = z[i] - cz;
+            float t = std::min(std::max((px * abx + py * aby + pz * abz) * invAb2, 0.0f), 1.0f);
+            float dx = px - t * abx, dy = py - t * aby, dz = pz - t * abz;
+            float length = std::sqrt(dx * dx + dy * dy + dz * dz);
+            float inverse = 1.0f / (length + 1e-30f);
+            out[i] = length - r;
+            normalX[i] = dx * inverse;
+            normalY[i] = dy * inverse + (length > 0.0f ? 0.0f : 1.0f);
+            normalZ[i] = dz * inverse;
+        }
+        break;
+    }
+    case ColliderType::Box: {
+        const glm::mat3 m = rotation;
+        const float hx = halfExtents.x, hy = halfExtents.y, hz = halfExtents.z;
+        #pragma omp simd
+        for (int i = 0; i < count; i++) {
+            float px = x[i] - cx, py = y[i] - cy, pz = z[i] - cz;
+            float qx = m[0].x * px + m[0].y * py + m[0].z * pz;
+            float qy = m[1].x * px + m[1].y * py + m[1].z * pz;
+            float qz = m[2].x * px + m[2].y * py + m[2].z * pz;
+            float dx = std::abs(qx) - hx, dy = std::abs(qy) - hy, dz = std::abs(qz) - hz;
+            float ox = std::max(dx, 0.0f), oy = std::max(dy, 0.0f), oz = std::max(dz, 0.0f);
+            float outside = std::sqrt(ox * ox + oy * oy + oz * oz);
+            float deepest = std::max(dx, std::max(dy, dz));
+            // Outside, along the offset from the box; inside, through the nearest face
+            float isOutside = outside > 0.0f ? 1.0f : 0.0f;
+            float inverse = 1.0f / (outside + 1e-30f);
+            bool alongX = dx == deepest, alongY = !alongX && dy == deepest, alongZ = !alongX && !alongY;
+            float lx = ox * inverse + (1.0f - isOutside) * (alongX ? 1.0f : 0.0f);
+            float ly = oy * inverse + (1.0f - isOutside) * (alongY ? 1.0f : 0.0f);
+            float lz = oz * inverse + (1.0f - isOutside) * (alongZ ? 1.0f : 0.0f);
+            lx *= qx < 0.0f ? -1.0f : 1.0f;
+            ly *= qy < 0.0f ? -1.0f : 1.0f;
+            lz *= qz < 0.0f ? -1.0f : 1.0f;
+            out[i] = isOutside * outside + (1.0f - isOutside) * deepest;
+            normalX[i] = m[0].x * lx + m[1].x * ly + m[2].x * lz;
+            normalY[i] = m[0].y * lx + m[1].y * ly + m[2].y * lz;
+            normalZ[i] = m[0].z * lx + m[1].z * ly + m[2].z * lz;
+        }
+        break;
+    }
+    case ColliderType::Heightfield: {
+        // Above the surface no point of it is closer than the height gap over the steepest
+        //  slope; below, the depth is taken along the local normal. Beside the footprint only
+        //  its sides are near. Five interpolated lookups per point, gathers that are not worth
+        //  vectorising.
+        const float slopeScale = 1.0f / std::sqrt(1.0f + maxSlope * maxSlope);
+        const float farX = cx + (float)(nx - 1) * spacing, farZ = cz + (float)(nz - 1) * spacing;
+        const float half = 0.5f * spacing, invSpacing = 1.0f / spacing;
+        for (int i = 0; i < count; i++) {
+            float h = heightAt(x[i], z[i]);
+            float gx = (heightAt(x[i] + half, z[i]) - heightAt(x[i] - half, z[i])) * invSpacing;
+            float gz = (heightAt(x[i], z[i] + half) - heightAt(x[i], z[i] - half)) * invSpacing;
+            float inverse = 1.0f / std::sqrt(1.0f + gx * gx + gz * gz);
+            float gap = y[i] - h;
+            float d = gap * (gap > 0.0f ? slopeScale : inverse);
+            float sx = x[i] - std::min(std::max(x[i], cx), farX), sz = z[i] - std::min(std::max(z[i], cz), farZ);
+            float side = std::sqrt(sx * sx + sz * sz);
+            float sideInverse = 1.0f / std::max(side, 1e-30f);
+            bool beside = side > 0.0f;
+            out[i] = beside ? std::max(side, d) : d;
+            normalX[i] = beside ? sx * sideInverse : -gx * inverse;
+            normalY[i] = beside ? 0.0f : inverse;
+            normalZ[i] = beside ? sz * sideInverse : -gz * inverse;
+        }
+        break;
+    }
+    case ColliderType::Sdf: {
+        // One trilinear lookup per point, independent of the mesh it was built from
+        const glm::mat3 inverse = glm::transpose(rotation);
+        for (int i = 0; i < count; i++) {
+            glm::vec3 gradient;
+            float d = field->sample(inverse * (glm::vec3(x[i], y[i], z[i]) - center), gradient);
+            float length = glm::length(gradient);
+            glm::vec3 normal = length > 0.0f ? rotation * (gradient / length) : glm::vec3(0.0f, 1.0f, 0.0f);
+            out[i] = d - radius;
+            normalX[i] = normal.x;
+            normalY[i] = normal.y;
+            normalZ[i] = normal.z;
+        }
+        break;
+    }
+    }
+}
+
+float Collider::
+steepestSlope() const {
+    // The gradient of a bilinear cell is affine in the cell coordinates, so its length peaks
+    //  at a corner, where it is made of the two edge differences meeting there
+    float steepest = 0.0f;
+    for (unsigned int j = 0; j + 1 < nz; j++) {
+        for (unsigned int i = 0; i + 1 < nx; i++) {
+            float h00 = heights[j * nx + i], h10 = heights[j * nx + i + 1];
+            float h01 = heights[(j + 1) * nx + i], h11 = heights[(j + 1) * nx + i + 1];
+            float x0 = h10 - h00, x1 = h11 - h01, z0 = h01 - h00, z1 = h11 - h10;
+            float corner = std::max(std::max(x0 * x0 + z0 * z0, x0 * x0 + z1 * z1),
+                                    std::max(x1 * x1 + z0 * z0, x1 * x1 + z1 * z1));
+            steepest = std::max(steepest, corner);
+        }
+    }
+    return glm::sqrt(steepest) / spacing;
+}
+
+bool Collider::
+sweep(const glm::vec3& p0, const glm::vec3& p1, float& toi, glm::vec3& normal) const {
+    const glm::vec3 motion = p1 - p0;
+    const float length = glm::length(motion);
+    if (length <= 0.0f) {
+        return false;
+    }
+
+    if (type == ColliderType::Plane) {
+        float d0 = glm::dot(p0 - center, axis), d1 = glm::dot(p1 - center, axis);
+        if (d0 < 0.0f || d1 >= 0.0f) {
+            return false;
+        }
+        toi = d0 / (d0 - d1);
+        normal = axis;
+        return true;
+    }
+
+    if (type == ColliderType::Sphere) {
+        glm::vec3 m = p0 - center;
+        float b = glm::dot(m, motion), c = glm::dot(m, m) - radius * radius;
+        float a = length * length;
+        float discriminant = b * b - a * c;
+        if (c < 0.0f || b > 0.0f || discriminant < 0.0f) {
+            return false;
+        }
+        float t = (-b - glm::sqrt(discriminant)) / a;
+        if (t > 1.0f) {
+            return false;
+        }
+        toi = glm::max(t, 0.0f);
+        normal = glm::normalize(p0 + toi * motion - center);
+        return true;
+    }
+
+    // Conservative advancement: never step further than the distance to the surface, which
+    //  for every shape here is at most the true distance
+    float t = 0.0f;
+    const float tolerance = 1e-4f * length + 1e-6f;
+    for (int iteration = 0; iteration < 32; iteration++) {
+        float d = distance(p0 + t * motion, normal);
+        if (d < tolerance) {
+            if (t == 0.0f && d < 0.0f) {
+                return false;
+            }
+            toi = t;
+            return true;
+        }
+        t += d / length;
+        if (t > 1.0f) {
+            return false;
+        }
+    }
+    // Still approaching, e.g. grazing: stop at the last clear time rather than pass through
+    toi = t;
+    return true;
+}
+
+bool Collider::
+triangleContact(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c,
+                glm::vec3& barycentric, float& depth, glm::vec3& normal) const {
+    glm::vec3 faceNormal = glm::cross(b - a, c - a);
+    float area = glm::length(faceNormal);
+    if (area <= 0.0f) {
+        return false;
+    }
+    faceNormal /= area;
+
+    switch (type) {
+    case ColliderType::Plane:
+        return false;
+    case ColliderType::Sphere: {
+        glm::vec3 d = closestPointOnTriangle(center, a, b, c, barycentric) - center;
+        float length = glm::length(d);
+        depth = length - radius;
+        normal = length > 0.0f ? d / length : faceNormal;
+        return depth < 0.0f;
+    }
+    case ColliderType::Capsule: {
+        // Closest pair between the segment and the triangle: an end point against the face,
+        //  or the segment against one of the edges
+        float best = unbounded;
+        glm::vec3 onSegment, onTriangle;
+        for (const glm::vec3& end : {center, axis}) {
+            glm::vec3 w;
+            glm::vec3 closest = closestPointOnTriangle(end, a, b, c, w);
+            float length = glm::length(end - closest);
+            if (length < best) {
+                best = length; onSegment = end; onTriangle = closest; barycentric = w;
+            }
+        }
+        const glm::vec3 corners[3] = {a, b, c};
+        for (int k = 0; k < 3; k++) {
+            float s, t;
+            float length = segmentSegmentDistance(center, axis, corners[k], corners[(k + 1) % 3], s, t);
+            if (length < best) {
+                best = length;
+                onSegment = glm::mix(center, axis, s);
+                onTriangle = glm::mix(corners[k], corners[(k + 1) % 3], t);
+                barycentric = glm::vec3(0.0f);
+                barycentric[k] = 1.0f - t;
+                barycentric[(k + 1) % 3] = t;
+            }
+        }
+        // The segment may also pierce the face
+        float da = glm::dot(center - a, faceNormal), db = glm::dot(axis - a, faceNormal);
+        if ((da < 0.0f) != (db < 0.0f)) {
+            glm::vec3 hit = glm::mix(center, axis, da / (da - db));
+            glm::vec3 w;
+            if (glm::length(closestPointOnTriangle(hit, a, b, c, w) - hit) < 1e-6f) {
+                best = 0.0f; onSegment = hit; onTriangle = hit; barycentric = w;
+            }
+        }
+        depth = best - radius;
+        if (best > 1e-6f) {
+            normal = (onTriangle - onSegment) / best;
+        } else {
+            // Pierced: leave toward the side the rest of the triangle is on
+            float t;
+            glm::vec3 side = (a + b + c) / 3.0f - closestPointOnSegment((a + b + c) / 3.0f, center, axis, t);
+            normal = glm::dot(side, faceNormal) < 0.0f ? -faceNormal : faceNormal;
+        }
+        return depth < 0.0f;
+    }
+    case ColliderType::Box:
+    case ColliderType::Heightfield:
+    case ColliderType::Sdf:
+    default: {
+        // No closed form: sample the centroid and the edge midpoints, plus the point nearest a box center
+        glm::vec3 samples[5] = {
+            glm::vec3(1.0f / 3.0f),
+            glm::vec3(0.5f, 0.5f, 0.0f),
+            glm::vec3(0.0f, 0.5f, 0.5f),
+            glm::vec3(0.5f, 0.0f, 0.5f),
+            glm::vec3(0.0f)
+        };
+        int sampleCount = 4;
+        if (type == ColliderType::Box) {
+            closestPointOnTriangle(center, a, b, c, samples[sampleCount++]);
+        }
+        depth = unbounded;
+        for (int k = 0; k < sampleCount; k++) {
+            glm::vec3 n;
+            float d = distance(samples[k].x * a + samples[k].y * b + samples[k].z * c, n);
+            if (d < depth) {
+                depth = d; normal = n; barycentric = samples[k];
+            }
+        }
+        return depth < 0.0f;
+    }
+    }
+}
+
+unsigned int ColliderSet::
+add(const Collider& collider) {
+    colliders.push_back(collider);
+    colliderBounds.push_back(collider.bounds());
+    colliderTravel.push_back(0.0);
+    boundsTravel.push_back(0.0);
+    edits++;
+    return (unsigned int)colliders.size() - 1;
+}
+
+unsigned int ColliderSet::
+addSphere(const glm::vec3& center, float radius) {
+    Collider collider;
+    collider.type = ColliderType::Sphere;
+    collider.center = center;
+    collider.radius = radius;
+    return add(collider);
+}
+
+unsigned int ColliderSet::
+addPlane(const glm::vec3& point, const glm::vec3& normal) {
+    Collider collider;
+    collider.type = ColliderType::Plane;
+    collider.center = point;
+    collider.axis = glm::normalize(normal);
+    return add(collider);
+}
+
+unsigned int ColliderSet::
+addCapsule(const glm::vec3& a, const glm::vec3& b, float radius) {
+    Collider collider;
+    collider.type = ColliderType::Capsule;
+    collider.center = a;
+    collider.axis = b;
+    collider.radius = radius;
+    return add(collider);
+}
+
+unsigned int ColliderSet::
+addBox(const glm::vec3& center, const glm::vec3& halfExtents, const glm::mat3& rotation) {
+    Collider collider;
+    collider.type = ColliderType::Box;
+    collider.center = center;
+    collider.halfExtents = halfExtents;
+    collider.rotation = rotation;
+    return add(collider);
+}
+
+unsigned int ColliderSet::
+addHeightfield(const glm::vec3& corner, float spacing, unsigned int nx, unsigned int nz,
+               const std::vector<float>& heights) {
+    Collider collider;
+    collider.type = ColliderType::Heightfield;
+    collider.center = corner;
+    collider.spacing = spacing;
+    collider.nx = std::max(nx, 2u);
+    collider.nz = std::max(nz, 2u);
+    collider.heights = heights;
+    collider.heights.resize(collider.nx * collider.nz, 0.0f);
+    collider.maxSlope = collider.steepestSlope();
+    return add(collider);
+}
+
+unsigned int ColliderSet::
+addSdf(const SignedDistanceField* field, const glm::vec3& center, const glm::mat3& rotation, float thickness) {
+    Collider collider;
+    collider.type = ColliderType::Sdf;
+    collider.field = field;
+    collider.center = center;
+    collider.rotation = rotation;
+    collider.radius = thickness;
+    return add(collider);
+}
+
+void ColliderSet::
+updateBounds() {
+    // Colliders may have been edited through get() since the last step; moves made by
+    //  advance() are accounted for in 'colliderTravel' and do not count as edits
+    for (unsigned int c = 0; c < colliders.size(); c++) {
+        Aabb box = colliders[c].bounds();
+        bool moved = box.min != colliderBounds[c].min || box.max != colliderBounds[c].max;
+        edits += moved && colliderTravel[c] == boundsTravel[c] ? 1u : 0u;
+        colliderBounds[c] = box;
+        if (colliders[c].type == ColliderType::Heightfield) {
+            colliders[c].maxSlope = colliders[c].steepestSlope();
+        }
+        boundsTravel[c] = colliderTravel[c];
+    }
+}
+
+void ColliderSet::
+moveTo(unsigned int idx, const glm::vec3& pivot, const glm::mat3& rotation, float frameTime) {
+    Collider& collider = colliders[idx];
+    if (frameTime <= 0.0f) {
+        return;
+    }
+    collider.velocity = (pivot - collider.pivot()) / frameTime;
+
+    // Shortest rotation from the current orientation to the target
+    glm::quat turn = glm::quat_cast(rotation * glm::transpose(collider.rotation));
+    if (turn.w < 0.0f) {
+        turn = -turn;
+    }
+    float angle = glm::angle(turn);
+    collider.angularVelocity = angle > 1e-6f ? glm::axis(turn) * (angle / frameTime) : glm::vec3(0.0f);
+}
+
+void ColliderSet::
+advance(float timeStep) {
+    for (unsigned int c = 0; c < colliders.size(); c++) {
+        Collider& collider = colliders[c];
+        if (collider.velocity == glm::vec3(0.0f) && collider.angularVelocity == glm::vec3(0.0f)) {
+            continue;
+        }
+        // Bound on how far any surface point moves: the rotation sweeps at most the box's half diagonal
+        const Aabb& box = colliderBounds[c];
+        float reach = collider.type == ColliderType::Plane || collider.type == ColliderType::Heightfield
+            ? (collider.angularVelocity == glm::vec3(0.0f) ? 0.0f : std::numeric_limits<float>::infinity())
+            : glm::length(glm::max(glm::abs(box.min - collider.pivot()), glm::abs(box.max - collider.pivot())));
+        float motion = (glm::length(collider.velocity) + glm::length(collider.angularVelocity) * reach) * timeStep;
+        // A turning plane has no bound, every cache starts over
+        if (std::isinf(motion)) {
+            edits++;
+        } else {
+            colliderTravel[c] += motion;
+        }
+        collider.advance(timeStep);
+    }
+    clock += timeStep;
+}
+
+unsigned int ColliderSet::
+sweep(const std::vector<glm::vec3>& previous, std::vector<glm::vec3>& positions,
+      std::vector<glm::vec3>& hitNormals, unsigned int tileSize) {
+    hitNormals.assign(positions.size(), glm::vec3(0.0f));
+    if (colliders.empty() || positions.empty()) {
+        return 0;
+    }
+    updateBounds();
+
+    const int count = (int)positions.size();
+    const int tiles = (count + (int)tileSize - 1) / (int)tileSize;
+    unsigned int hits = 0;
+
+    #pragma omp parallel for reduction(+:hits) schedule(dynamic, 4)
+    for (int tile = 0; tile < tiles; tile++) {
+        const int first = tile * (int)tileSize;
+        const int last = std::min(first + (int)tileSize, count);
+
+        // The swept box of the tile bounds every trajectory in it over the step
+        Aabb tileBounds;
+        for (int i = first; i < last; i++) {
+            tileBounds.expand(previous[i]);
+            tileBounds.expand(positions[i]);
+        }
+
+        for (unsigned int c = 0; c < colliders.size(); c++) {
+            if (!tileBounds.overlaps(colliderBounds[c])) {
+                continue;
+            }
+            for (int i = first; i < last; i++) {
+                float toi;
+                glm::vec3 normal;
+                if (!colliders[c].sweep(previous[i], positions[i], toi, normal)) {
+                    continue;
+                }
+                glm::vec3 motion = positions[i] - previous[i];
+                glm::vec3 remaining = (1.0f - toi) * motion;
+                glm::vec3 contact = previous[i] + toi * motion;
+                positions[i] = contact + remaining - glm::min(glm::dot(remaining, normal), 0.0f) * normal;
+                hitNormals[i] = normal;
+                hits++;
+            }
+        }
+    }
+    return hits;
+}
+
+unsigned int ColliderSet::
+resolveTriangles(std::vector<glm::vec3>& positions, const std::vector<glm::uvec3>& triangles,
+                 const ClothBvh& bvh, std::vector<glm::vec4>& corrections) {
+    corrections.assign(positions.size(), glm::vec4(0.0f));
+    if (colliders.empty() || positions.empty()) {
+        return 0;
+    }
+    updateBounds();
+
+    // Candidate (triangle, collider) pairs from the BVH
+    candidates.clear();
+    candidateColliders.clear();
+    for (unsigned int c = 0; c < colliders.size(); c++) {
+        if (colliders[c].type == ColliderType::Plane) {
+            continue;
+        }
+        bvh.query(colliderBounds[c], [&](unsigned int t) {
+            pushScratch(candidates, t);
+            pushScratch(candidateColliders, c);
+        });
+    }
+
+    // Corrections are accumulated (xyz) with a contact count (w), then averaged per vertex
+    unsigned int contacts = 0;
+    #pragma omp parallel for reduction(+:contacts) schedule(dynamic, 64)
+    for (int k = 0; k < (int)candidates.size(); k++) {
+        const glm::uvec3 tri = triangles[candidates[k]];
+        glm::vec3 barycentric, normal;
+        float depth;
+        if (!colliders[candidateColliders[k]].triangleContact(
+                positions[tri.x], positions[tri.y], positions[tri.z], barycentric, depth, normal)) {
+            continue;
+        }
+        // Smallest vertex moves that carry the contact point 'depth' out along the normal
+        glm::vec3 push = -depth / glm::dot(barycentric, barycentric) * normal;
+        for (int v = 0; v < 3; v++) {
+            glm::vec4& correction = corrections[tri[v]];
+            glm::vec3 move = barycentric[v] * push;
+            #pragma omp atomic
+            correction.x += move.x;
+            #pragma omp atomic
+            correction.y += move.y;
+            #pragma omp atomic
+            correction.z += move.z;
+            #pragma omp atomic
+            correction.w += 1.0f;
+        }
+        contacts++;
+    }
+
+    #pragma omp parallel for
+    for (int i = 0; i < (int)positions.size(); i++) {
+        if (corrections[i].w > 0.0f) {
+            corrections[i] /= corrections[i].w;
+            positions[i] += glm::vec3(corrections[i]);
+        }
+    }
+    return contacts;
+}
+
+unsigned int ColliderSet::
+resolve(std::vector<glm::vec3>& positions, ContactCache& cache, unsigned int tileSize) {
+    const int count = (int)positions.size();
+    cache.resize((unsigned int)count);
+    if (colliders.empty() || positions.empty()) {
+        cache.contacts.clear();
+        cache.offsets.assign(count + 1, 0u);
+        return 0;
+    }
+    updateBounds();
+    if (cache.editsSeen != edits || cache.travelSeen.size() != colliders.size()) {
+        cache.invalidate();
+        cache.travelSeen = colliderTravel;
+        cache.clockSeen = clock;
+        cache.editsSeen = edits;
+    }
+    // Motion since this cache was last resolved
+    const float elapsed = (float)(clock - cache.clockSeen);
+    float motion = 0.0f;
+    for (unsigned int c = 0; c < colliders.size(); c++) {
+        motion = std::max(motion, (float)(colliderTravel[c] - cache.travelSeen[c]));
+    }
+
+    const int tiles = (count + (int)tileSize - 1) / (int)tileSize;
+    const float margin = cache.margin;
+    const float skin = 0.5f * margin;
+    resizeScratch(cache.tileContacts, tiles);
+
+    // Contacts with a collider that moved are queried again, everything else only loses
+    //  reach by the largest move
+    #pragma omp parallel for
+    for (int i = 0; i < count; i++) {
+        float radius = cache.radii[i] - motion;
+        for (unsigned int k = cache.offsets[i]; k < cache.offsets[i + 1]; k++) {
+            const unsigned int c = cache.contacts[k].collider;
+            radius = colliderTravel[c] > cache.travelSeen[c] ? -1.0f : radius;
+        }
+        cache.radii[i] = radius;
+    }
+
+    // Particles out of reach of their last narrowphase are queried together
+    queries.clear();
+    for (int i = 0; i < count; i++) {
+        if (glm::length(positions[i] - cache.references[i]) > cache.radii[i]) {
+            pushScratch(queries, (unsigned int)i);
+        }
+    }
+    const int queryCount = (int)queries.size();
+    const size_t runs = (size_t)queryCount * colliders.size();
+    resizeScratch(queryPoints, 3 * (size_t)queryCount);
+    resizeScratch(queryDistances, runs);
+    resizeScratch(queryNormals, 3 * runs);
+    float* qx = queryPoints.data();
+    float* qy = qx + queryCount;
+    float* qz = qy + queryCount;
+
+    // In chunks, each against the colliders near it through their batch kernels; far ones
+    //  only bound the clearance, which the box test below covers
+    const int chunks = (queryCount + (int)tileSize - 1) / (int)tileSize;
+    #pragma omp parallel for schedule(dynamic, 4)
+    for (int chunk = 0; chunk < chunks; chunk++) {
+        const int first = chunk * (int)tileSize;
+        const int last = std::min(first + (int)tileSize, queryCount);
+
+        Aabb chunkBounds;
+        for (int k = first; k < last; k++) {
+            const glm::vec3 p = positions[queries[k]];
+            qx[k] = p.x; qy[k] = p.y; qz[k] = p.z;
+            chunkBounds.expand(p);
+        }
+
+        for (unsigned int c = 0; c < colliders.size(); c++) {
+            if (!chunkBounds.overlaps(colliderBounds[c].inflated(margin))) {
+                continue;
+            }
+            float* d = queryDistances.data() + c * (size_t)queryCount;
+            float* n = queryNormals.data() + 3 * c * (size_t)queryCount;
+            colliders[c].distances(qx + first, qy + first, qz + first, last - first,
+                                   d + first, n + first, n + queryCount + first, n + 2 * queryCount + first);
+        }
+    }
+
+    #pragma omp parallel for schedule(dynamic, 4)
+    for (int tile = 0; tile < tiles; tile++) {
+        const int first = tile * (int)tileSize;
+        const int last = std::min(first + (int)tileSize, count);
+        std::vector<Contact>& found = cache.tileContacts[tile];
+        found.clear();
+        int query = (int)(std::lower_bound(queries.begin(), queries.end(), (unsigned int)first) - queries.begin());
+
+        for (int i = first; i < last; i++) {
+            glm::vec3 p = positions[i];
+            const Contact* cached = cache.contacts.data() + cache.offsets[i];
+            const unsigned int cachedCount = cache.offsets[i + 1] - cache.offsets[i];
+            const size_t begin = found.size();
+
+            if (query == queryCount || queries[query] != (unsigned int)i) {
+                // Still within reach of the last narrowphase
+                appendScratch(found, cached, cached + cachedCount);
+            } else {
+                // Narrowphase results of this particle
+                float clearance = std::numeric_limits<float>::max();
+                for (unsigned int c = 0; c < colliders.size(); c++) {
+                    float lowerBound = colliderBounds[c].distanceTo(p);
+                    if (lowerBound >= margin) {
+                        clearance = std::min(clearance, lowerBound);
+                        continue;
+                    }
+                    // Its chunk overlapped the inflated box too, so the kernel ran
+                    const float d = queryDistances[c * (size_t)queryCount + query];
+                    const float* n = queryNormals.data() + 3 * c * (size_t)queryCount + query;
+                    const glm::vec3 normal(n[0], n[queryCount], n[2 * queryCount]);
+                    if (d >= margin) {
+                        clearance = std::min(clearance, d);
+                        continue;
+                    }
+                    Contact contact;
+                    contact.particle = (unsigned int)i;
+                    contact.collider = c;
+                    contact.anchor = p;
+                    // Carry the friction state of a contact that persists
+                    for (unsigned int k = 0; k < cachedCount; k++) {
+                        if (cached[k].collider == c) {
+                            contact = cached[k];
+                        }
+                    }
+                    contact.normal = normal;
+                    contact.surface = p - d * normal;
+                    pushScratch(found, contact);
+                }
+                cache.references[i] = p;
+                cache.radii[i] = found.size() > begin ? std::min(margin, clearance) : clearance;
+                query++;
+            }
+
+            // Push out against the tangent planes, then Coulomb friction in position form: the
+            //  tangential motion since last step is undone up to 'friction' times the push-out
+            for (size_t k = begin; k < found.size(); k++) {
+                Contact& contact = found[k];
+                float d = glm::dot(p - contact.surface, contact.normal);
+                // Resting in a thin skin above the surface (e.g. lifted by the triangle pass)
+                //  still counts, with the friction bound of the last push
+                contact.touching = d < skin;
+                contact.sticking = false;
+                if (contact.touching) {
+                    const Collider& collider = colliders[contact.collider];
+                    p -= std::min(d, 0.0f) * contact.normal;
+                    float bound = collider.friction * std::max(-d, contact.lambda);
+                    // Slip relative to the surface, which carries the anchor along
+                    glm::vec3 slip = p - (contact.anchor + elapsed * collider.velocityAt(contact.anchor));
+                    slip -= glm::dot(slip, contact.normal) * contact.normal;
+                    float length = glm::length(slip);
+                    contact.sticking = length <= bound;
+                    p -= contact.sticking ? slip : slip * (bound / length);
+                }
+                contact.lambda = !contact.touching ? 0.0f : (d < 0.0f ? -d : contact.lambda);
+                contact.anchor = p;
+            }
+            positions[i] = p;
+        }
+    }
+
+    cache.travelSeen = colliderTravel;
+    cache.clockSeen = clock;
+
+    // Concatenate the tiles, particles stay in order
+    cache.contacts.clear();
+    for (int tile = 0; tile < tiles; tile++) {
+        appendScratch(cache.contacts, cache.tileContacts[tile].begin(), cache.tileContacts[tile].end());
+    }
+    unsigned int touching = 0;
+    cache.offsets.assign(count + 1, 0u);
+    for (const Contact& contact : cache.contacts) {
+        cache.offsets[contact.particle + 1]++;
+        touching += contact.touching ? 1u : 0u;
+    }
+    for (int i = 0; i < count; i++) {
+        cache.offsets[i + 1] += cache.offsets[i];
+    }
+    return touching;
+}
@@ -0,0 +1,85 @@
+#include "perf_counters.hpp"
+
+#ifdef __linux__
+#include <cerrno>
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+PerfCounters::
+PerfCounters(bool inheritThreads) {
+    for (int& fd : fds) {
+        fd = -1;
+    }
+#ifdef __linux__
+    const uint64_t configs[(int)PerfEvent::Count] = {
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_MISSES,
+        PERF_COUNT_HW_BRANCH_MISSES
+    };
+    for (int e = 0; e < (int)PerfEvent::Count; e++) {
+        perf_event_attr attributes;
+        memset(&attributes, 0, sizeof(attributes));
+        attributes.size = sizeof(attributes);
+        attributes.type = PERF_TYPE_HARDWARE;
+        attributes.config = configs[e];
+        attributes.disabled = 1;
+        attributes.exclude_kernel = 1; // allowed up to perf_event_paranoid 2
+        attributes.exclude_hv = 1;
+        attributes.inherit = inheritThreads ? 1 : 0; // read() then adds up the threads' counts
+        attributes.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        fds[e] = (int)syscall(SYS_perf_event_open, &attributes, 0, -1, -1, 0);
+        if (fds[e] < 0) {
+            if (problem.empty()) {
+                problem = std::string(perfEventName((PerfEvent)e)) + ": " + strerror(errno);
+            }
+            continue;
+        }
+        ioctl(fds[e], PERF_EVENT_IOC_RESET, 0);
+        ioctl(fds[e], PERF_EVENT_IOC_ENABLE, 0);
+    }
+#else
+    (void)inheritThreads;
+    problem = "perf_event_open is Linux only";
+#endif
+}
+
+PerfCounters::
+~PerfCounters() {
+#ifdef __linux__
+    for (int fd : fds) {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+#endif
+}
+
+bool PerfCounters::
+isAnyAvailable() const {
+    for (int fd : fds) {
+        if (fd >= 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void PerfCounters::
+read(uint64_t values[(int)PerfEvent::Count]) const {
+    for (int e = 0; e < (int)PerfEvent::Count; e++) {
+        values[e] = 0;
+#ifdef __linux__
+        // value, time enabled, time running
+        uint64_t data[3];
+        if (fds[e] < 0 || ::read(fds[e], data, sizeof(data)) != (ssize_t)sizeof(data) || data[2] == 0) {
+            continue;
+        }
+        values[e] = data[2] < data[1] ? (uint64_t)((double)data[0] * (double)data[1] / (double)data[2]) : data[0];
+#endif
+    }
+}
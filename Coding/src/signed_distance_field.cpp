@@ -0,0 +1,408 @@
+#include "signed_distance_field.hpp"
+
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define SDF_USE_MMAP
+#endif
+
+#include "geometry.hpp"
+
+static const char sdfMagic[4] = {'C', 'S', 'D', 'F'};
+static const uint32_t sdfVersion = 1;
+
+SignedDistanceField::
+~SignedDistanceField() {
+    release();
+}
+
+void SignedDistanceField::
+release() {
+#ifdef SDF_USE_MMAP
+    if (mapping) {
+        munmap(mapping, mappingSize);
+    }
+#endif
+    mapping = nullptr;
+    mappingSize = 0;
+    table = nullptr;
+    data = nullptr;
+    ownedTable.clear();
+    ownedData.clear();
+}
+
+void SignedDistanceField::
+build(
+    const std::vector<glm::vec3>& vertices,
+    const std::vector<glm::uvec3>& triangles,
+    float voxelSize,
+    unsigned int bandVoxels
+) {
+    release();
+    if (vertices.empty() || triangles.empty()) {
+        return;
+    }
+    // Distances are stored relative to the band, which must hold at least one voxel
+    if (bandVoxels == 0 || !(voxelSize > 0.0f)) {
+        std::cout << "ERROR::SDF::INVALID_BAND " << bandVoxels << " voxels of " << voxelSize << std::endl;
+        return;
+    }
+    for (const glm::uvec3& triangle : triangles) {
+        if (glm::any(glm::greaterThanEqual(triangle, glm::uvec3((unsigned int)vertices.size())))) {
+            std::cout << "ERROR::SDF::INVALID_MESH vertex index out of range" << std::endl;
+            return;
+        }
+    }
+
+    this->voxelSize = voxelSize;
+    this->band = (float)bandVoxels * voxelSize;
+
+    // Pad by more than the band so that the outermost nodes are always outside
+    Aabb meshBounds;
+    for (const glm::vec3& v : vertices) {
+        meshBounds.expand(v);
+    }
+    const float padding = band + 2.0f * voxelSize;
+    origin = meshBounds.min - padding;
+    glm::vec3 extent = meshBounds.max - meshBounds.min + 2.0f * padding;
+    glm::uvec3 nodes = glm::uvec3(glm::ceil(extent / voxelSize)) + 1u;
+    bricks = (nodes + brickSize - 1u) / brickSize;
+    nodes = bricks * brickSize;
+
+    // Dense scratch grid, only alive during the build
+    const std::size_t total = (std::size_t)nodes.x * nodes.y * nodes.z;
+    std::vector<float> distance(total, band);
+    std::vector<float> alignment(total, 0.0f);
+    std::vector<int8_t> sign(total, 0);
+    auto nodeIdx = [&](unsigned int x, unsigned int y, unsigned int z) {
+        return ((std::size_t)z * nodes.y + y) * nodes.x + x;
+    };
+
+    for (const glm::uvec3& tri : triangles) {
+        const glm::vec3 a = vertices[tri.x], b = vertices[tri.y], c = vertices[tri.z];
+        glm::vec3 normal = glm::cross(b - a, c - a);
+        float normalLength = glm::length(normal);
+        if (normalLength <= 0.0f) {
+            continue;
+        }
+        normal /= normalLength;
+
+        Aabb box;
+        box.expand(a); box.expand(b); box.expand(c);
+        glm::uvec3 lo = glm::uvec3(glm::max((box.min - band - origin) / voxelSize, glm::vec3(0.0f)));
+        glm::uvec3 hi = glm::min(glm::uvec3(glm::ceil((box.max + band - origin) / voxelSize)), nodes - 1u);
+
+        for (unsigned int z = lo.z; z <= hi.z; z++) {
+            for (unsigned int y = lo.y; y <= hi.y; y++) {
+                for (unsigned int x = lo.x; x <= hi.x; x++) {
+                    glm::vec3 p = origin + glm::vec3((float)x, (float)y, (float)z) * voxelSize;
+                    glm::vec3 barycentric;
+                    glm::vec3 offset = p - closestPointOnTriangle(p, a, b, c, barycentric);
+                    float d = glm::length(offset);
+                    if (d >= band) {
+                        continue;
+                    }
+                    // Near edges several triangles are equally close; the most face-on one has the right sign
+                    float facing = d > 0.0f ? glm::abs(glm::dot(offset, normal)) / d : 1.0f;
+                    std::size_t i = nodeIdx(x, y, z);
+                    bool closer = d < distance[i] - 1e-6f * voxelSize;
+                    bool tie = !closer && d <= distance[i] + 1e-6f * voxelSize && facing > alignment[i];
+                    if (sign[i] == 0 || closer || tie) {
+                        distance[i] = d;
+                        alignment[i] = facing;
+                        sign[i] = glm::dot(offset, normal) >= 0.0f ? 1 : -1;
+                    }
+                }
+            }
+        }
+    }
+
+    // Nodes the band did not reach are outside if connected to the domain boundary, inside otherwise
+    std::vector<std::size_t> queue;
+    auto visit = [&](unsigned int x, unsigned int y, unsigned int z) {
+        std::size_t i = nodeIdx(x, y, z);
+        if (sign[i] == 0) {
+            sign[i] = 2; // reached, unbanded
+            queue.push_back(i);
+        }
+    };
+    for (unsigned int z = 0; z < nodes.z; z++) {
+        for (unsigned int y = 0; y < nodes.y; y++) {
+            for (unsigned int x = 0; x < nodes.x; x++) {
+                if (x == 0 || y == 0 || z == 0 || x == nodes.x - 1 || y == nodes.y - 1 || z == nodes.z - 1) {
+                    visit(x, y, z);
+                }
+            }
+        }
+    }
+    while (!queue.empty()) {
+        std::size_t i = queue.back();
+        queue.pop_back();
+        unsigned int x = (unsigned int)(i % nodes.x);
+        unsigned int y = (unsigned int)((i / nodes.x) % nodes.y);
+        unsigned int z = (unsigned int)(i / ((std::size_t)nodes.x * nodes.y));
+        if (x > 0) visit(x - 1, y, z);
+        if (x < nodes.x - 1) visit(x + 1, y, z);
+        if (y > 0) visit(x, y - 1, z);
+        if (y < nodes.y - 1) visit(x, y + 1, z);
+        if (z > 0) visit(x, y, z - 1);
+        if (z < nodes.z - 1) visit(x, y, z + 1);
+    }
+
+    // Pack: keep the bricks that contain banded nodes
+    ownedTable.assign((std::size_t)bricks.x * bricks.y * bricks.z, outsideBrick);
+    for (unsigned int bz = 0; bz < bricks.z; bz++) {
+        for (unsigned int by = 0; by < bricks.y; by++) {
+            for (unsigned int bx = 0; bx < bricks.x; bx++) {
+                bool banded = false;
+                bool inside = false;
+                for (unsigned int k = 0; k < brickVolume && !banded; k++) {
+                    std::size_t i = nodeIdx(bx * brickSize + k % brickSize,
+                                            by * brickSize + (k / brickSize) % brickSize,
+                                            bz * brickSize + k / (brickSize * brickSize));
+                    banded = sign[i] == 1 || sign[i] == -1;
+                    inside = sign[i] == 0;
+                }
+
+                std::size_t brickIdx = ((std::size_t)bz * bricks.y + by) * bricks.x + bx;
+                if (!banded) {
+                    ownedTable[brickIdx] = inside ? insideBrick : outsideBrick;
+                    continue;
+                }
+
+                ownedTable[brickIdx] = (int32_t)(ownedData.size() / brickVolume);
+                for (unsigned int k = 0; k < brickVolume; k++) {
+                    std::size_t i = nodeIdx(bx * brickSize + k % brickSize,
+                                            by * brickSize + (k / brickSize) % brickSize,
+                                            bz * brickSize + k / (brickSize * brickSize));
+                    float d = sign[i] == 0 ? -band : (sign[i] == 2 ? band : (float)sign[i] * distance[i]);
+                    ownedData.push_back((int16_t)std::lround(glm::clamp(d / band, -1.0f, 1.0f) * 32767.0f));
+                }
+            }
+        }
+    }
+
+    table = ownedTable.data();
+    data = ownedData.data();
+}
+
+bool SignedDistanceField::
+save(const std::string& path) const {
+    if (isEmpty()) {
+        std::cout << "ERROR::SDF::NOTHING_TO_SAVE" << std::endl;
+        return false;
+    }
+
+    FileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, sdfMagic, 4);
+    header.version = sdfVersion;
+    header.bricks[0] = bricks.x; header.bricks[1] = bricks.y; header.bricks[2] = bricks.z;
+    std::size_t tableSize = (std::size_t)bricks.x * bricks.y * bricks.z;
+    std::size_t brickCount = 0;
+    for (std::size_t i = 0; i < tableSize; i++) {
+        brickCount += table[i] >= 0 ? 1 : 0;
+    }
+    header.brickCount = (uint32_t)brickCount;
+    header.origin[0] = origin.x; header.origin[1] = origin.y; header.origin[2] = origin.z;
+    header.voxelSize = voxelSize;
+    header.band = band;
+
+    std::ofstream file(path, std::ios::binary);
+    if (!file) {
+        std::cout << "ERROR::SDF::FILE_NOT_WRITABLE " << path << std::endl;
+        return false;
+    }
+    file.write((const char*)&header, sizeof(header));
+    file.write((const char*)table, sizeof(int32_t) * tableSize);
+    file.write((const char*)data, sizeof(int16_t) * brickVolume * brickCount);
+    return (bool)file;
+}
+
+bool SignedDistanceField::
+load(const std::string& path) {
+    release();
+
+    FileHeader header;
+    const char* base = nullptr;
+    std::size_t fileSize = 0;
+
+#ifdef SDF_USE_MMAP
+    int fd = open(path.c_str(), O_RDONLY);
+    struct stat status;
+    if (fd < 0 || fstat(fd, &status) != 0 || (std::size_t)status.st_size < sizeof(FileHeader)) {
+        if (fd >= 0) close(fd);
+        std::cout << "ERROR::SDF::FILE_NOT_SUCCESFULLY_READ " << path << std::endl;
+        return false;
+    }
+    fileSize = (std::size_t)status.st_size;
+    void* mapped = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        std::cout << "ERROR::SDF::FILE_NOT_SUCCESFULLY_READ " << path << std::endl;
+        return false;
+    }
+    mapping = mapped;
+    mappingSize = fileSize;
+    base = (const char*)mapped;
+    std::memcpy(&header, base, sizeof(header));
+#else
+    std::ifstream file(path, std::ios::binary);
+    if (!file.read((char*)&header, sizeof(header))) {
+        std::cout << "ERROR::SDF::FILE_NOT_SUCCESFULLY_READ " << path << std::endl;
+        return false;
+    }
+#endif
+
+    // Brick counts whose product overflows are rejected before any size is derived from them
+    const uint64_t gridLimit = 1ull << 32;
+    uint64_t planeSize = (uint64_t)header.bricks[0] * header.bricks[1];
+    bool validGrid = header.bricks[0] > 0 && header.bricks[1] > 0 && header.bricks[2] > 0
+        && planeSize < gridLimit && planeSize * header.bricks[2] < gridLimit;
+    std::size_t tableSize = validGrid ? (std::size_t)(planeSize * header.bricks[2]) : 0;
+    std::size_t expected = sizeof(FileHeader) + sizeof(int32_t) * tableSize
+        + sizeof(int16_t) * brickVolume * header.brickCount;
+    if (std::memcmp(header.magic, sdfMagic, 4) != 0 || header.version != sdfVersion || !validGrid
+        || !(header.voxelSize > 0.0f) || !(header.band > 0.0f)
+#ifdef SDF_USE_MMAP
+        || fileSize < expected
+#endif
+    ) {
+        std::cout << "ERROR::SDF::INVALID_FILE " << path << std::endl;
+        release();
+        return false;
+    }
+
+    bricks = glm::uvec3(header.bricks[0], header.bricks[1], header.bricks[2]);
+    origin = glm::vec3(header.origin[0], header.origin[1], header.origin[2]);
+    voxelSize = header.voxelSize;
+    band = header.band;
+
+#ifdef SDF_USE_MMAP
+    table = (const int32_t*)(base + sizeof(FileHeader));
+    data = (const int16_t*)(base + sizeof(FileHeader) + sizeof(int32_t) * tableSize);
+#else
+    ownedTable.resize(tableSize);
+    ownedData.resize((std::size_t)brickVolume * header.brickCount);
+    file.read((char*)ownedTable.data(), sizeof(int32_t) * tableSize);
+    file.read((char*)ownedData.data(), sizeof(int16_t) * ownedData.size());
+    if (!file) {
+        std::cout << "ERROR::SDF::INVALID_FILE " << path << std::endl;
+        release();
+        return false;
+    }
+    table = ownedTable.data();
+    data = ownedData.data();
+#endif
+
+    // Every entry is a flag or one of the stored bricks, so that lookups stay inside the data
+    for (std::size_t i = 0; i < tableSize; i++) {
+        if (table[i] != outsideBrick && table[i] != insideBrick
+            && (table[i] < 0 || (uint64_t)table[i] >= header.brickCount)) {
+            std::cout << "ERROR::SDF::INVALID_FILE " << path << std::endl;
+            release();
+            return false;
+        }
+    }
+    return true;
+}
+
+Aabb SignedDistanceField::
+bounds() const {
+    return Aabb(origin, origin + glm::vec3(bricks * brickSize - 1u) * voxelSize);
+}
+
+float SignedDistanceField::
+nodeValue(unsigned int x, unsigned int y, unsigned int z) const {
+    std::size_t brickIdx = ((std::size_t)(z / brickSize) * bricks.y + y / brickSize) * bricks.x + x / brickSize;
+    int32_t entry = table[brickIdx];
+    if (entry == outsideBrick) return band;
+    if (entry == insideBrick) return -band;
+    unsigned int local = ((z % brickSize) * brickSize + y % brickSize) * brickSize + x % brickSize;
+    return (float)data[(std::size_t)entry * brickVolume + local] * (band / 32767.0f);
+}
+
+float SignedDistanceField::
+sample(const glm::vec3& p, glm::vec3& gradient) const {
+    gradient = glm::vec3(0.0f);
+    if (isEmpty()) {
+        return band;
+    }
+
+    // Outside the grid everything is beyond the band
+    glm::vec3 u = (p - origin) / voxelSize;
+    glm::vec3 last = glm::vec3(bricks * brickSize - 1u);
+    if (glm::any(glm::lessThan(u, glm::vec3(0.0f))) || glm::any(glm::greaterThanEqual(u, last))) {
+        return band;
+    }
+
+    glm::vec3 f = glm::floor(u);
+    glm::vec3 t = u - f;
+    unsigned int x = (unsigned int)f.x, y = (unsigned int)f.y, z = (unsigned int)f.z;
+    float c000 = nodeValue(x, y, z), c100 = nodeValue(x + 1, y, z);
+    float c010 = nodeValue(x, y + 1, z), c110 = nodeValue(x + 1, y + 1, z);
+    float c001 = nodeValue(x, y, z + 1), c101 = nodeValue(x + 1, y, z + 1);
+    float c011 = nodeValue(x, y + 1, z + 1), c111 = nodeValue(x + 1, y + 1, z + 1);
+
+    float c00 = glm::mix(c000, c100, t.x), c10 = glm::mix(c010, c110, t.x);
+    float c01 = glm::mix(c001, c101, t.x), c11 = glm::mix(c011, c111, t.x);
+    float c0 = glm::mix(c00, c10, t.y), c1 = glm::mix(c01, c11, t.y);
+
+    // Analytic derivative of the trilinear interpolant
+    float dx0 = glm::mix(c100 - c000, c110 - c010, t.y), dx1 = glm::mix(c101 - c001, c111 - c011, t.y);
+    gradient.x = glm::mix(dx0, dx1, t.z);
+    gradient.y = glm::mix(c10 - c00, c11 - c01, t.z);
+    gradient.z = c1 - c0;
+    gradient /= voxelSize;
+
+    return glm::mix(c0, c1, t.z);
+}
+
+bool loadObjMesh(const std::string& path, std::vector<glm::vec3>& vertices, std::vector<glm::uvec3>& triangles) {
+    std::ifstream file(path);
+    if (!file) {
+        std::cout << "ERROR::OBJ::FILE_NOT_SUCCESFULLY_READ " << path << std::endl;
+        return false;
+    }
+
+    vertices.clear();
+    triangles.clear();
+    std::string line;
+    while (std::getline(file, line)) {
+        std::istringstream stream(line);
+        std::string keyword;
+        stream >> keyword;
+        if (keyword == "v") {
+            glm::vec3 v;
+            stream >> v.x >> v.y >> v.z;
+            vertices.push_back(v);
+        } else if (keyword == "f") {
+            std::vector<unsigned int> face;
+            std::string token;
+            while (stream >> token) {
+                // "v", "v/vt" or "v/vt/vn"; 1 based, or negative counting back from the last vertex so far
+                long idx = std::strtol(token.c_str(), nullptr, 10);
+                long resolved = idx < 0 ? (long)vertices.size() + idx : idx - 1;
+                if (idx == 0 || resolved < 0 || resolved >= (long)vertices.size()) {
+                    std::cout << "ERROR::OBJ::INVALID_FACE " << path << ": " << line << std::endl;
+                    vertices.clear();
+                    triangles.clear();
+                    return false;
+                }
+                face.push_back((unsigned int)resolved);
+            }
+            for (std::size_t k = 2; k < face.size(); k++) {
+                triangles.push_back(glm::uvec3(face[0], face[k - 1], face[k]));
+            }
+        }
+    }
+    return !vertices.empty() && !triangles.empty();
+}
@@ -0,0 +1,73 @@
+#include "spatial_hash.hpp"
+#include "allocation_tracker.hpp"
+
+#include <algorithm>
+
+SpatialHash::
+SpatialHash(float cellSize) : cellSize(cellSize) {}
+
+void SpatialHash::
+build(const std::vector<glm::vec3>& positions) {
+    const int count = (int)positions.size();
+
+    // About two buckets per point keeps chains short
+    unsigned int tableSize = 1u;
+    while (tableSize < 2u * (unsigned int)count) {
+        tableSize <<= 1;
+    }
+    tableMask = tableSize - 1;
+
+    resizeScratch(keys, count);
+    resizeScratch(sortedIndices, count);
+    assignScratch(cellStart, tableSize + 1, 0u);
+    resizeScratch(cellCursor, tableSize);
+
+    // Count
+    #pragma omp parallel for
+    for (int i = 0; i < count; i++) {
+        glm::ivec3 cell = cellOf(positions[i]);
+        unsigned int key = hash(cell.x, cell.y, cell.z);
+        keys[i] = key;
+        #pragma omp atomic
+        cellStart[key + 1]++;
+    }
+
+    // Inclusive scan of the counts in fixed blocks: block totals, scan of totals, then each block
+    const int blocks = 64;
+    const unsigned int blockLength = (tableSize + blocks - 1) / blocks;
+    assignScratch(blockSums, blocks + 1, 0u);
+    #pragma omp parallel for
+    for (int b = 0; b < blocks; b++) {
+        unsigned int first = 1 + b * blockLength, last = std::min(first + blockLength, tableSize + 1);
+        unsigned int sum = 0;
+        for (unsigned int k = first; k < last; k++) {
+            sum += cellStart[k];
+        }
+        blockSums[b + 1] = sum;
+    }
+    for (int b = 0; b < blocks; b++) {
+        blockSums[b + 1] += blockSums[b];
+    }
+    #pragma omp parallel for
+    for (int b = 0; b < blocks; b++) {
+        unsigned int first = 1 + b * blockLength, last = std::min(first + blockLength, tableSize + 1);
+        unsigned int sum = blockSums[b];
+        for (unsigned int k = first; k < last; k++) {
+            sum += cellStart[k];
+            cellStart[k] = sum;
+        }
+    }
+
+    // Scatter
+    #pragma omp parallel for
+    for (int b = 0; b < (int)tableSize; b++) {
+        cellCursor[b] = cellStart[b];
+    }
+    #pragma omp parallel for
+    for (int i = 0; i < count; i++) {
+        unsigned int slot;
+        #pragma omp atomic capture
+        slot = cellCursor[keys[i]]++;
+        sortedIndices[slot] = (unsigned int)i;
+    }
+}
@@ -0,0 +1,93 @@
+#include "trace.hpp"
+
+#ifdef CLOTH_TRACE
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+struct TraceEvent {
+    const char* name;
+    uint64_t begin, end;
+};
+
+// Written by its thread only; 'written' counts every event ever recorded, the slot is written % capacity
+struct TraceBuffer {
+    static constexpr unsigned int capacity = 1u << 16;
+    std::vector<TraceEvent> events = std::vector<TraceEvent>(capacity);
+    std::atomic<uint64_t> written{0};
+    unsigned int thread;
+};
+
+// Buffers outlive their threads, so that a dump at exit still sees OpenMP workers' events
+std::mutex registryMutex;
+std::vector<std::unique_ptr<TraceBuffer>> registry;
+
+const std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now();
+
+void dumpAtExit() {
+    const char* path = getenv("CLOTH_TRACE_FILE");
+    if (path && *path) {
+        traceDump(path);
+    }
+}
+
+// Only the first record of every thread takes the lock
+TraceBuffer* registerThread() {
+    std::lock_guard<std::mutex> lock(registryMutex);
+    if (registry.empty()) {
+        atexit(dumpAtExit);
+    }
+    registry.push_back(std::make_unique<TraceBuffer>());
+    registry.back()->thread = (unsigned int)registry.size();
+    return registry.back().get();
+}
+
+}
+
+uint64_t traceNow() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - origin).count();
+}
+
+void traceRecord(const char* name, uint64_t begin, uint64_t end) {
+    thread_local TraceBuffer* buffer = registerThread();
+    uint64_t n = buffer->written.load(std::memory_order_relaxed);
+    buffer->events[n % TraceBuffer::capacity] = {name, begin, end};
+    buffer->written.store(n + 1, std::memory_order_release);
+}
+
+bool traceDump(const char* path) {
+    FILE* file = fopen(path, "w");
+    if (!file) {
+        printf("ERROR::TRACE::CANNOT_WRITE %s\n", path);
+        return false;
+    }
+
+    // Complete ("X") events in microseconds; a thread recording meanwhile may overwrite its oldest ones
+    std::lock_guard<std::mutex> lock(registryMutex);
+    fprintf(file, "{\"traceEvents\": [\n");
+    bool first = true;
+    for (const std::unique_ptr<TraceBuffer>& buffer : registry) {
+        uint64_t written = buffer->written.load(std::memory_order_acquire);
+        uint64_t oldest = written > TraceBuffer::capacity ? written - TraceBuffer::capacity : 0;
+        for (uint64_t n = oldest; n < written; n++) {
+            const TraceEvent& event = buffer->events[n % TraceBuffer::capacity];
+            fprintf(file, "%s{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %u, \"ts\": %.3f, \"dur\": %.3f}",
+                    first ? "" : ",\n", event.name, buffer->thread, 1e-3 * (double)event.begin,
+                    1e-3 * (double)(event.end - event.begin));
+            first = false;
+        }
+    }
+    fprintf(file, "\n], \"displayTimeUnit\": \"ms\"}\n");
+    fclose(file);
+    printf("trace: %s\n", path);
+    return true;
+}
+
+#endif
@@ -0,0 +1,151 @@
+#include "wind_field.hpp"
+#include "allocation_tracker.hpp"
+
+#include <cmath>
+
+// Integer hash of a lattice point, mapped to [-1, 1]
+static float latticeValue(unsigned int x, unsigned int y, unsigned int z, unsigned int channel, unsigned int seed) {
+    unsigned int h = seed * 0x9E3779B9u;
+    h ^= x * 0x85EBCA6Bu; h = (h ^ (h >> 13)) * 0xC2B2AE35u;
+    h ^= y * 0x27D4EB2Fu; h = (h ^ (h >> 15)) * 0x165667B1u;
+    h ^= z * 0x9E3779B1u; h = (h ^ (h >> 16)) * 0x85EBCA77u;
+    h ^= channel * 0xC2B2AE3Du; h ^= h >> 16;
+    return (float)(h & 0xFFFFFFu) / (float)0xFFFFFFu * 2.0f - 1.0f;
+}
+
+static float smooth(float t) { return t * t * (3.0f - 2.0f * t); }
+
+// Periodic value noise with lattice spacing `spacing` on a volume of `resolution` cells
+static float valueNoise(unsigned int x, unsigned int y, unsigned int z, unsigned int spacing, unsigned int resolution,
+                        unsigned int channel, unsigned int seed) {
+    const unsigned int n = resolution / spacing;
+    const unsigned int x0 = x / spacing, y0 = y / spacing, z0 = z / spacing;
+    const unsigned int x1 = (x0 + 1) % n, y1 = (y0 + 1) % n, z1 = (z0 + 1) % n;
+    const float tx = smooth((float)(x % spacing) / (float)spacing);
+    const float ty = smooth((float)(y % spacing) / (float)spacing);
+    const float tz = smooth((float)(z % spacing) / (float)spacing);
+
+    float c00 = glm::mix(latticeValue(x0, y0, z0, channel, seed), latticeValue(x1, y0, z0, channel, seed), tx);
+    float c10 = glm::mix(latticeValue(x0, y1, z0, channel, seed), latticeValue(x1, y1, z0, channel, seed), tx);
+    float c01 = glm::mix(latticeValue(x0, y0, z1, channel, seed), latticeValue(x1, y0, z1, channel, seed), tx);
+    float c11 = glm::mix(latticeValue(x0, y1, z1, channel, seed), latticeValue(x1, y1, z1, channel, seed), tx);
+    return glm::mix(glm::mix(c00, c10, ty), glm::mix(c01, c11, ty), tz);
+}
+
+WindField::
+WindField(
+    unsigned int resolution,
+    float cellSize,
+    float strength,
+    const glm::vec3& scrollVelocity,
+    unsigned int seed
+) : cellSize(cellSize), strength(strength), scrollVelocity(scrollVelocity), offset(0.0f) {
+    // Round up to a power of two so that wrapping is a mask
+    this->resolution = 8u;
+    while (this->resolution < resolution) {
+        this->resolution <<= 1;
+    }
+    this->mask = this->resolution - 1;
+
+    buildVolume(seed);
+}
+
+void WindField::
+buildVolume(unsigned int seed) {
+    const unsigned int n = resolution;
+    const unsigned int total = n * n * n;
+
+    // Vector potential from three octaves of periodic value noise
+    std::vector<glm::vec3> potential(total, glm::vec3(0.0f));
+    const unsigned int spacings[3] = {8u, 4u, 2u};
+    const float amplitudes[3] = {1.0f, 0.5f, 0.25f};
+    for (unsigned int z = 0; z < n; z++) {
+        for (unsigned int y = 0; y < n; y++) {
+            for (unsigned int x = 0; x < n; x++) {
+                glm::vec3 psi(0.0f);
+                for (unsigned int o = 0; o < 3; o++) {
+                    for (unsigned int c = 0; c < 3; c++) {
+                        psi[c] += amplitudes[o] * valueNoise(x, y, z, spacings[o], n, c + 3 * o, seed);
+                    }
+                }
+                potential[idxFromCell(x, y, z)] = psi;
+            }
+        }
+    }
+
+    // The curl of the potential is divergence free, which is what makes it look like turbulence
+    vx.resize(total);
+    vy.resize(total);
+    vz.resize(total);
+    double sumSquared = 0.0;
+    for (unsigned int z = 0; z < n; z++) {
+        for (unsigned int y = 0; y < n; y++) {
+            for (unsigned int x = 0; x < n; x++) {
+                glm::vec3 dx = (potential[idxFromCell(x + 1, y, z)] - potential[idxFromCell(x - 1, y, z)]) * 0.5f;
+                glm::vec3 dy = (potential[idxFromCell(x, y + 1, z)] - potential[idxFromCell(x, y - 1, z)]) * 0.5f;
+                glm::vec3 dz = (potential[idxFromCell(x, y, z + 1)] - potential[idxFromCell(x, y, z - 1)]) * 0.5f;
+                glm::vec3 curl(dy.z - dz.y, dz.x - dx.z, dx.y - dy.x);
+
+                unsigned int i = idxFromCell(x, y, z);
+                vx[i] = curl.x;
+                vy[i] = curl.y;
+                vz[i] = curl.z;
+                sumSquared += glm::dot(curl, curl);
+            }
+        }
+    }
+
+    // Normalize to an RMS speed of `strength`
+    float scale = sumSquared > 0.0 ? strength / (float)std::sqrt(sumSquared / total) : 0.0f;
+    for (unsigned int i = 0; i < total; i++) {
+        vx[i] *= scale;
+        vy[i] *= scale;
+        vz[i] *= scale;
+    }
+}
+
+void WindField::
+setTime(float time) {
+    // Keep the offset inside one tile so that float precision does not degrade over time
+    glm::vec3 cells = scrollVelocity * time / cellSize;
+    offset = cells - glm::floor(cells / (float)resolution) * (float)resolution;
+}
+
+glm::vec3 WindField::
+sample(const glm::vec3& position) const {
+    glm::vec3 u = position / cellSize + offset;
+    glm::vec3 f = glm::floor(u);
+    glm::vec3 t = u - f;
+    unsigned int x = (unsigned int)(int)f.x, y = (unsigned int)(int)f.y, z = (unsigned int)(int)f.z;
+
+    unsigned int i000 = idxFromCell(x, y, z), i100 = idxFromCell(x + 1, y, z);
+    unsigned int i010 = idxFromCell(x, y + 1, z), i110 = idxFromCell(x + 1, y + 1, z);
+    unsigned int i001 = idxFromCell(x, y, z + 1), i101 = idxFromCell(x + 1, y, z + 1);
+    unsigned int i011 = idxFromCell(x, y + 1, z + 1), i111 = idxFromCell(x + 1, y + 1, z + 1);
+
+    float w000 = (1 - t.x) * (1 - t.y) * (1 - t.z), w100 = t.x * (1 - t.y) * (1 - t.z);
+    float w010 = (1 - t.x) * t.y * (1 - t.z), w110 = t.x * t.y * (1 - t.z);
+    float w001 = (1 - t.x) * (1 - t.y) * t.z, w101 = t.x * (1 - t.y) * t.z;
+    float w011 = (1 - t.x) * t.y * t.z, w111 = t.x * t.y * t.z;
+
+    return glm::vec3(
+        w000 * vx[i000] + w100 * vx[i100] + w010 * vx[i010] + w110 * vx[i110]
+            + w001 * vx[i001] + w101 * vx[i101] + w011 * vx[i011] + w111 * vx[i111],
+        w000 * vy[i000] + w100 * vy[i100] + w010 * vy[i010] + w110 * vy[i110]
+            + w001 * vy[i001] + w101 * vy[i101] + w011 * vy[i011] + w111 * vy[i111],
+        w000 * vz[i000] + w100 * vz[i100] + w010 * vz[i010] + w110 * vz[i110]
+            + w001 * vz[i001] + w101 * vz[i101] + w011 * vz[i011] + w111 * vz[i111]);
+}
+
+void WindField::
+sample(const std::vector<glm::vec3>& positions, std::vector<glm::vec3>& out) const {
+    resizeScratch(out, positions.size());
+    const int count = (int)positions.size();
+
+    // Every lookup gathers 24 floats, which the baseline x86-64 target cannot vectorise:
+    //  the points are spread over threads instead, as in WindGrid
+    #pragma omp parallel for
+    for (int i = 0; i < count; i++) {
+        out[i] = sample(positions[i]);
+    }
+}
@@ -0,0 +1,185 @@
+#include "wind_grid.hpp"
+#include "allocation_tracker.hpp"
+
+#include <utility>
+
+WindGrid::
+WindGrid(
+    const glm::uvec3& size,
+    const glm::vec3& origin,
+    float cellSize,
+    const glm::vec3& ambientVelocity
+) : size(glm::max(size, glm::uvec3(3u))), origin(origin), cellSize(cellSize), ambientVelocity(ambientVelocity) {
+    const unsigned int total = this->size.x * this->size.y * this->size.z;
+    velocity.assign(total, ambientVelocity);
+    advected.resize(total);
+    momentum.assign(total, glm::vec3(0.0f));
+    pressure.assign(total, 0.0f);
+    pressureNext.assign(total, 0.0f);
+    divergence.assign(total, 0.0f);
+}
+
+void WindGrid::
+step(float timeStep) {
+    applyMomentum();
+    advect(timeStep);
+    applyBoundary();
+    project();
+    applyBoundary();
+}
+
+void WindGrid::
+applyMomentum() {
+    const float scale = 1.0f / (airDensity * cellSize * cellSize * cellSize);
+    const int total = (int)velocity.size();
+
+    #pragma omp parallel for
+    for (int i = 0; i < total; i++) {
+        velocity[i] += momentum[i] * scale;
+        momentum[i] = glm::vec3(0.0f);
+    }
+}
+
+void WindGrid::
+advect(float timeStep) {
+    // Semi-Lagrangian: trace each cell centre back through the field
+    #pragma omp parallel for
+    for (int z = 0; z < (int)size.z; z++) {
+        for (unsigned int y = 0; y < size.y; y++) {
+            for (unsigned int x = 0; x < size.x; x++) {
+                unsigned int i = idxFromCell(x, y, z);
+                glm::vec3 centre = origin + (glm::vec3((float)x, (float)y, (float)z) + 0.5f) * cellSize;
+                advected[i] = sampleField(velocity, centre - timeStep * velocity[i]);
+            }
+        }
+    }
+    std::swap(velocity, advected);
+}
+
+void WindGrid::
+project() {
+    const float h = cellSize;
+
+    #pragma omp parallel for
+    for (int z = 1; z < (int)size.z - 1; z++) {
+        for (unsigned int y = 1; y < size.y - 1; y++) {
+            for (unsigned int x = 1; x < size.x - 1; x++) {
+                unsigned int i = idxFromCell(x, y, z);
+                divergence[i] = -0.5f * h * (
+                    velocity[idxFromCell(x + 1, y, z)].x - velocity[idxFromCell(x - 1, y, z)].x
+                    + velocity[idxFromCell(x, y + 1, z)].y - velocity[idxFromCell(x, y - 1, z)].y
+                    + velocity[idxFromCell(x, y, z + 1)].z - velocity[idxFromCell(x, y, z - 1)].z);
+                pressure[i] = 0.0f;
+            }
+        }
+    }
+
+    // Jacobi iterations, the boundary stays at zero pressure (open domain)
+    for (unsigned int iteration = 0; iteration < pressureIterations; iteration++) {
+        #pragma omp parallel for
+        for (int z = 1; z < (int)size.z - 1; z++) {
+            for (unsigned int y = 1; y < size.y - 1; y++) {
+                for (unsigned int x = 1; x < size.x - 1; x++) {
+                    unsigned int i = idxFromCell(x, y, z);
+                    pressureNext[i] = (divergence[i]
+                        + pressure[idxFromCell(x + 1, y, z)] + pressure[idxFromCell(x - 1, y, z)]
+                        + pressure[idxFromCell(x, y + 1, z)] + pressure[idxFromCell(x, y - 1, z)]
+                        + pressure[idxFromCell(x, y, z + 1)] + pressure[idxFromCell(x, y, z - 1)]) / 6.0f;
+                }
+            }
+        }
+        std::swap(pressure, pressureNext);
+    }
+
+    #pragma omp parallel for
+    for (int z = 1; z < (int)size.z - 1; z++) {
+        for (unsigned int y = 1; y < size.y - 1; y++) {
+            for (unsigned int x = 1; x < size.x - 1; x++) {
+                unsigned int i = idxFromCell(x, y, z);
+                velocity[i] -= 0.5f / h * glm::vec3(
+                    pressure[idxFromCell(x + 1, y, z)] - pressure[idxFromCell(x - 1, y, z)],
+                    pressure[idxFromCell(x, y + 1, z)] - pressure[idxFromCell(x, y - 1, z)],
+                    pressure[idxFromCell(x, y, z + 1)] - pressure[idxFromCell(x, y, z - 1)]);
+            }
+        }
+    }
+}
+
+void WindGrid::
+applyBoundary() {
+    #pragma omp parallel for
+    for (int z = 0; z < (int)size.z; z++) {
+        for (unsigned int y = 0; y < size.y; y++) {
+            for (unsigned int x = 0; x < size.x; x++) {
+                if (isBoundary(x, y, z)) {
+                    velocity[idxFromCell(x, y, z)] = ambientVelocity;
+                }
+            }
+        }
+    }
+}
+
+glm::vec3 WindGrid::
+sampleField(const std::vector<glm::vec3>& field, const glm::vec3& position) const {
+    glm::vec3 u = (position - origin) / cellSize - 0.5f;
+    u = glm::clamp(u, glm::vec3(0.0f), glm::vec3(size - 1u) - 0.001f);
+    glm::vec3 f = glm::floor(u);
+    glm::vec3 t = u - f;
+    unsigned int x = (unsigned int)f.x, y = (unsigned int)f.y, z = (unsigned int)f.z;
+
+    glm::vec3 c00 = glm::mix(field[idxFromCell(x, y, z)], field[idxFromCell(x + 1, y, z)], t.x);
+    glm::vec3 c10 = glm::mix(field[idxFromCell(x, y + 1, z)], field[idxFromCell(x + 1, y + 1, z)], t.x);
+    glm::vec3 c01 = glm::mix(field[idxFromCell(x, y, z + 1)], field[idxFromCell(x + 1, y, z + 1)], t.x);
+    glm::vec3 c11 = glm::mix(field[idxFromCell(x, y + 1, z + 1)], field[idxFromCell(x + 1, y + 1, z + 1)], t.x);
+    return glm::mix(glm::mix(c00, c10, t.y), glm::mix(c01, c11, t.y), t.z);
+}
+
+glm::vec3 WindGrid::
+sample(const glm::vec3& position) const {
+    glm::vec3 u = (position - origin) / cellSize;
+    if (glm::any(glm::lessThan(u, glm::vec3(0.0f))) || glm::any(glm::greaterThanEqual(u, glm::vec3(size)))) {
+        return ambientVelocity;
+    }
+    return sampleField(velocity, position);
+}
+
+void WindGrid::
+sample(const std::vector<glm::vec3>& positions, std::vector<glm::vec3>& out) const {
+    resizeScratch(out, positions.size());
+    const int count = (int)positions.size();
+
+    #pragma omp parallel for
+    for (int i = 0; i < count; i++) {
+        out[i] = sample(positions[i]);
+    }
+}
+
+void WindGrid::
+splat(const std::vector<glm::vec3>& positions, const std::vector<glm::vec3>& momenta) {
+    const int count = (int)positions.size();
+
+    #pragma omp parallel for
+    for (int i = 0; i < count; i++) {
+        glm::vec3 u = (positions[i] - origin) / cellSize - 0.5f;
+        if (glm::any(glm::lessThan(u, glm::vec3(0.0f))) || glm::any(glm::greaterThanEqual(u, glm::vec3(size - 1u)))) {
+            continue;
+        }
+        glm::vec3 f = glm::floor(u);
+        glm::vec3 t = u - f;
+        unsigned int x = (unsigned int)f.x, y = (unsigned int)f.y, z = (unsigned int)f.z;
+
+        // Trilinear weights, the transpose of sampleField
+        for (unsigned int corner = 0; corner < 8; corner++) {
+            unsigned int dx = corner & 1u, dy = (corner >> 1) & 1u, dz = (corner >> 2) & 1u;
+            float w = (dx ? t.x : 1.0f - t.x) * (dy ? t.y : 1.0f - t.y) * (dz ? t.z : 1.0f - t.z);
+            glm::vec3& target = momentum[idxFromCell(x + dx, y + dy, z + dz)];
+            glm::vec3 value = w * momenta[i];
+            #pragma omp atomic
+            target.x += value.x;
+            #pragma omp atomic
+            target.y += value.y;
+            #pragma omp atomic
+            target.z += value.z;
+        }
+    }
+}
@@ -0,0 +1,251 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "cloth_simulator.hpp"
+
+// Accuracy against cost of the hanging cloth, for choosing the step size and solver effort:
+//  cloth_accuracy [--duration 1.0] [--stiffness 40] [--reference-dt 0.00002] [--max-rms 0.01] [--quick]
+// A reference is run with the explicit step at a tiny dt, then every configuration (explicit or
+// barrier step, step size, Newton and CG iterations) is compared with it every 'sampleInterval':
+//  rms     position error over all samples and particles (m)
+//  stretch largest structural strain seen, against the reference's
+//  energy  largest energy difference, relative to the energy the reference released
+// Configurations no other one beats in cost and all three errors are on the Pareto front.
+
+using Clock = std::chrono::steady_clock;
+
+const float sampleInterval = 0.05f;
+
+struct Configuration {
+    bool implicit; // barrier step, with colliders and self contact off
+    float timeStep;
+    unsigned int newtonIterations;
+    unsigned int cgIterations;
+};
+
+// What a run leaves behind at every sample
+struct Trajectory {
+    std::vector<std::vector<glm::vec3>> positions;
+    std::vector<double> energy; // relative to the start
+    float stretch = 0.0f; // largest structural strain
+    double msPerSecond = 0.0; // wall clock per simulated second
+    bool stable = true;
+};
+
+struct Row {
+    Configuration configuration;
+    double rms, stretchError, energyError, msPerSecond;
+    bool stable, pareto = false;
+};
+
+float duration = 1.0f;
+float stiffness = 40.0f;
+float referenceTimeStep = 0.00002f;
+double maxRms = 0.01;
+bool quick = false;
+
+void parseParameters(int argc, char* argv[]);
+
+// Largest relative elongation of the grid's structural edges
+static float structuralStrain(const RectCloth& cloth, const RectClothSimulator& simulator)
+{
+    float strain = 0.0f;
+    for (unsigned int ih = 0; ih < cloth.nh; ih++) {
+        for (unsigned int iw = 0; iw < cloth.nw; iw++) {
+            unsigned int idx = ih * cloth.nw + iw;
+            if (iw + 1 < cloth.nw)
+                strain = glm::max(strain, glm::length(simulator.getPosition(idx + 1) - simulator.getPosition(idx)) / cloth.dx - 1.0f);
+            if (ih + 1 < cloth.nh)
+                strain = glm::max(strain, glm::length(simulator.getPosition(idx + cloth.nw) - simulator.getPosition(idx)) / cloth.dx - 1.0f);
+        }
+    }
+    return strain;
+}
+
+Trajectory run(const Configuration& configuration)
+{
+    // The viewer's cloth and settings, only the stiffness can change
+    auto clothTransform = glm::rotate(glm::mat4(1.0f), glm::radians(60.0f), {1.0f, 0.0f, 0.0f});
+    RectCloth cloth(40, 30, 0.1f, clothTransform);
+    RectClothSimulator simulator(&cloth, 1.0f, stiffness, 0.001f, {0.0f, -9.81f, 0.0f});
+    simulator.is_wind = false;
+    simulator.is_collision = false;
+    simulator.is_barrier = configuration.implicit;
+    simulator.setSolverIterations(configuration.newtonIterations, configuration.cgIterations);
+
+    Trajectory trajectory;
+    const unsigned int count = cloth.nw * cloth.nh;
+    const int stepsPerSample = (int)roundf(sampleInterval / configuration.timeStep);
+    const int samples = (int)roundf(duration / sampleInterval);
+    const double startEnergy = simulator.totalEnergy();
+
+    double elapsed = 0.0;
+    for (int sample = 0; sample < samples && trajectory.stable; sample++) {
+        Clock::time_point start = Clock::now();
+        for (int i = 0; i < stepsPerSample; i++)
+            simulator.step(configuration.timeStep);
+        elapsed += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+        std::vector<glm::vec3> positions(count);
+        for (unsigned int idx = 0; idx < count; idx++) {
+            positions[idx] = simulator.getPosition(idx);
+            if (!std::isfinite(positions[idx].x + positions[idx].y + positions[idx].z))
+                trajectory.stable = false;
+        }
+        trajectory.positions.push_back(positions);
+        trajectory.energy.push_back(simulator.totalEnergy() - startEnergy);
+        trajectory.stretch = glm::max(trajectory.stretch, structuralStrain(cloth, simulator));
+    }
+    trajectory.msPerSecond = elapsed / duration;
+    return trajectory;
+}
+
+Row compare(const Configuration& configuration, const Trajectory& trajectory, const Trajectory& reference)
+{
+    Row row;
+    row.configuration = configuration;
+    row.msPerSecond = trajectory.msPerSecond;
+    row.stable = trajectory.stable && trajectory.positions.size() == reference.positions.size();
+    row.rms = row.stretchError = row.energyError = 0.0;
+    if (!row.stable)
+        return row;
+
+    double squared = 0.0, released = 1e-12;
+    size_t terms = 0;
+    for (size_t sample = 0; sample < reference.positions.size(); sample++) {
+        for (size_t idx = 0; idx < reference.positions[sample].size(); idx++) {
+            glm::vec3 d = trajectory.positions[sample][idx] - reference.positions[sample][idx];
+            squared += glm::dot(d, d);
+            terms++;
+        }
+        released = std::max(released, std::abs(reference.energy[sample]));
+        row.energyError = std::max(row.energyError, std::abs(trajectory.energy[sample] - reference.energy[sample]));
+    }
+    row.rms = std::sqrt(squared / (double)terms);
+    row.stretchError = std::abs(trajectory.stretch - reference.stretch);
+    row.energyError /= released;
+    // Blown up without producing infinities
+    row.stable = row.rms < 1.0;
+    return row;
+}
+
+static std::string describe(const Configuration& configuration)
+{
+    char buffer[64];
+    if (configuration.implicit)
+        snprintf(buffer, sizeof(buffer), "barrier  dt %.5f newton %2u cg %3u", configuration.timeStep,
+                 configuration.newtonIterations, configuration.cgIterations);
+    else
+        snprintf(buffer, sizeof(buffer), "explicit dt %.5f", configuration.timeStep);
+    return buffer;
+}
+
+int main(int argc, char* argv[])
+{
+    parseParameters(argc, argv);
+
+    std::vector<Configuration> configurations;
+    std::vector<float> explicitSteps = {0.00025f, 0.0005f, 0.001f, 0.002f, 0.0025f, 0.005f};
+    std::vector<float> implicitSteps = {0.001f, 0.002f, 0.005f, 0.01f, 0.025f};
+    std::vector<unsigned int> newton = {1, 2, 4, 8};
+    std::vector<unsigned int> cg = {10, 100};
+    if (quick) {
+        explicitSteps = {0.0005f, 0.002f, 0.005f};
+        implicitSteps = {0.002f, 0.01f};
+        newton = {1, 4};
+        cg = {10};
+    }
+    for (float dt : explicitSteps)
+        configurations.push_back({false, dt, 0, 0});
+    for (float dt : implicitSteps)
+        for (unsigned int n : newton)
+            for (unsigned int c : cg)
+                configurations.push_back({true, dt, n, c});
+
+    printf("reference: explicit dt %g over %g s, stiffness %g\n", referenceTimeStep, duration, stiffness);
+    fflush(stdout);
+    Trajectory reference = run({false, referenceTimeStep, 0, 0});
+    if (!reference.stable) {
+        printf("ERROR::ACCURACY::REFERENCE_UNSTABLE\n");
+        return 1;
+    }
+    printf("reference: %.1f ms per simulated second, stretch %.4f\n\n", reference.msPerSecond, reference.stretch);
+
+    std::vector<Row> rows;
+    for (const Configuration& configuration : configurations) {
+        rows.push_back(compare(configuration, run(configuration), reference));
+        fprintf(stderr, "%s done\n", describe(configuration).c_str());
+    }
+
+    // The front: no other stable configuration is at least as cheap and as accurate in every measure
+    for (Row& row : rows) {
+        if (!row.stable)
+            continue;
+        row.pareto = true;
+        for (const Row& other : rows) {
+            if (&other == &row || !other.stable)
+                continue;
+            bool noWorse = other.msPerSecond <= row.msPerSecond && other.rms <= row.rms &&
+                           other.stretchError <= row.stretchError && other.energyError <= row.energyError;
+            bool better = other.msPerSecond < row.msPerSecond || other.rms < row.rms ||
+                          other.stretchError < row.stretchError || other.energyError < row.energyError;
+            if (noWorse && better) {
+                row.pareto = false;
+                break;
+            }
+        }
+    }
+
+    std::sort(rows.begin(), rows.end(), [](const Row& a, const Row& b) { return a.msPerSecond < b.msPerSecond; });
+    printf("%-36s %10s %10s %10s %10s  %s\n", "configuration", "ms/sim s", "rms (m)", "stretch", "energy", "pareto");
+    const Row* cheapest = nullptr;
+    for (const Row& row : rows) {
+        if (!row.stable) {
+            printf("%-36s %10.1f %10s\n", describe(row.configuration).c_str(), row.msPerSecond, "unstable");
+            continue;
+        }
+        printf("%-36s %10.1f %10.2e %10.2e %9.2f%%  %s\n", describe(row.configuration).c_str(), row.msPerSecond,
+               row.rms, row.stretchError, 100.0 * row.energyError, row.pareto ? "*" : "");
+        if (!cheapest && row.rms <= maxRms)
+            cheapest = &row;
+    }
+    if (cheapest)
+        printf("\ncheapest within %g m rms: %s, %.1f ms per simulated second\n", maxRms,
+               describe(cheapest->configuration).c_str(), cheapest->msPerSecond);
+    else
+        printf("\nno configuration within %g m rms\n", maxRms);
+    return 0;
+}
+
+void parseParameters(int argc, char* argv[])
+{
+    for (int i = 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "--duration") == 0 && hasValue) {
+            duration = (float)atof(argv[++i]);
+        } else if (strcmp(argv[i], "--stiffness") == 0 && hasValue) {
+            stiffness = (float)atof(argv[++i]);
+        } else if (strcmp(argv[i], "--reference-dt") == 0 && hasValue) {
+            referenceTimeStep = (float)atof(argv[++i]);
+        } else if (strcmp(argv[i], "--max-rms") == 0 && hasValue) {
+            maxRms = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--quick") == 0) {
+            quick = true;
+        } else {
+            printf("Invalid parameter %s, please check your spelling.\n", argv[i]);
+            exit(1);
+        }
+    }
+    if (duration < sampleInterval || referenceTimeStep <= 0.0f) {
+        printf("Invalid duration or reference step.\n");
+        exit(1);
+    }
+}
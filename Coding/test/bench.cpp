@@ -0,0 +1,792 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <optional>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "cloth_scene.hpp"
+#include "cloth_simulator.hpp"
+#include "perf_counters.hpp"
+
+// Benchmark of the simulation core over grid sizes, thread counts and modes:
+//  cloth_bench [--grids 40x30,256x256] [--threads 1,4] [--modes hang,wind,collision,colliders,cloths]
+//              [--seconds 1.0] [--out results.json] [--compare baseline.json] [--tolerance 0.1] [--roofline]
+// Every configuration is stepped until it ran for the given wall-clock time. Results go out
+// as JSON, one configuration per line; with --compare, configurations more than 'tolerance'
+// slower per step than the baseline are flagged and the exit code is 1. 'colliders' is the
+// collision mode with two dozen spheres, capsules and boxes under the cloth, a heightfield and a plane;
+// 'cloths' drops a second cloth of the grid's size onto the first through a ClothScene, and its
+// figures cover both.
+// Where perf_event_open permits, a further short run reads hardware counters around every phase
+// (opened before any parallel region, so they add up all OpenMP threads, idle waiting included)
+// and reports IPC, LLC traffic per particle (misses times the line size) and LLC misses per
+// spring; otherwise the counters are left out.
+// With --roofline, the host's bandwidth (STREAM triads over working sets from the first level
+// cache to past the last) and arithmetic peak (independent multiply-adds, as this build vectorises
+// them) are probed for every thread count, and the phases with a traffic model
+// (RectClothSimulator::estimateTraffic) report their achieved bytes/s and FLOP/s against the
+// roofline min(peak, intensity * bandwidth). The bandwidth is the triad's at the phase's working
+// set, the bytes its model walks, so a phase whose arrays fit in a cache is held to that cache.
+// Grids of 64x64 and larger also time the picking queries (raycast, nearestParticle and
+// particlesWithin) on the final cloth, reporting mean and worst latency per query, and check
+// their answers against brute force over every particle and triangle; a mismatch is reported
+// and the exit code is 1.
+
+using Clock = std::chrono::steady_clock;
+
+struct Configuration {
+    unsigned int nw, nh;
+    int threads;
+    std::string mode;
+};
+
+struct Result {
+    Configuration configuration;
+    double constructionMs;
+    int steps;
+    double msPerStep;
+    double phaseMs[(int)StepPhase::Count]; // per step
+    unsigned int particles, springs; // of all cloths
+    bool hasCounters;
+    double phaseCounts[(int)StepPhase::Count][(int)PerfEvent::Count]; // per step
+    bool phaseModelled[(int)StepPhase::Count];
+    double phaseBytes[(int)StepPhase::Count], phaseFlops[(int)StepPhase::Count]; // per step, modelled
+    bool hasPicking;
+    double pickingUs[3], pickingMaxUs[3]; // per query: raycast, nearest particle, particles within
+    int pickingMismatches;
+};
+
+struct HostLimits {
+    int threads;
+    std::vector<double> workingSets; // of the triads (three arrays), ascending
+    std::vector<double> bandwidths; // bytes/s of the triad at each working set
+    double flopsPerSecond;
+
+    // Triad bandwidth of the smallest probed working set that holds 'bytes', the largest past all
+    double bytesPerSecond(double bytes) const {
+        for (unsigned int k = 0; k < workingSets.size(); k++)
+            if (bytes <= workingSets[k])
+                return bandwidths[k];
+        return bandwidths.back();
+    }
+};
+
+// Accumulates the wall-clock time of every phase, and its hardware counts when given counters
+class PhaseTimer : public StepObserver {
+public:
+    double total[(int)StepPhase::Count] = {};
+    double counts[(int)StepPhase::Count][(int)PerfEvent::Count] = {};
+    const PerfCounters* counters = nullptr;
+
+    void phaseBegin(StepPhase phase) override {
+        if (counters)
+            counters->read(beginCounts[(int)phase]);
+        begin[(int)phase] = Clock::now();
+    }
+    void phaseEnd(StepPhase phase) override {
+        total[(int)phase] += std::chrono::duration<double, std::milli>(Clock::now() - begin[(int)phase]).count();
+        if (counters) {
+            uint64_t end[(int)PerfEvent::Count];
+            counters->read(end);
+            for (int e = 0; e < (int)PerfEvent::Count; e++)
+                counts[(int)phase][e] += (double)(end[e] - beginCounts[(int)phase][e]);
+        }
+    }
+
+private:
+    Clock::time_point begin[(int)StepPhase::Count];
+    uint64_t beginCounts[(int)StepPhase::Count][(int)PerfEvent::Count];
+};
+
+const PerfCounters* counters = nullptr; // when any is available
+const double cacheLineBytes = 64.0;
+const char* pickingQueryNames[3] = {"raycast", "nearest", "within"};
+const unsigned int pickingMinParticles = 64 * 64;
+const int pickingQueries = 1000;
+
+std::vector<Configuration> configurations;
+double secondsPerConfiguration = 1.0;
+const char* outputPath = nullptr;
+const char* baselinePath = nullptr;
+double tolerance = 0.1;
+bool roofline = false;
+std::vector<HostLimits> hostLimits;
+
+void parseParameters(int argc, char* argv[]);
+Result run(const Configuration& configuration);
+std::string toJson(const Result& result);
+int compare(const std::vector<Result>& results, const char* path);
+HostLimits probeHost(int threads);
+void printRoofline(const std::vector<Result>& results);
+void timePicking(RectClothSimulator& simulator, const RectCloth& cloth, float radius, Result& result);
+
+static double millisecondsSince(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+int main(int argc, char* argv[])
+{
+    parseParameters(argc, argv);
+
+    // Before the first parallel region, so that the OpenMP threads inherit the counters
+    PerfCounters perfCounters(true);
+    if (perfCounters.isAnyAvailable())
+        counters = &perfCounters;
+    if (!perfCounters.getProblem().empty())
+        printf("hardware counters: %s, %s\n", counters ? "partly available" : "not available",
+               perfCounters.getProblem().c_str());
+
+    if (roofline) {
+        for (const Configuration& configuration : configurations) {
+            bool probed = false;
+            for (const HostLimits& limits : hostLimits)
+                probed = probed || limits.threads == configuration.threads;
+            if (probed)
+                continue;
+            hostLimits.push_back(probeHost(configuration.threads));
+            const HostLimits& limits = hostLimits.back();
+            printf("host, %d threads: %.2f GFLOP/s multiply-add, triad GB/s", configuration.threads, 1e-9 * limits.flopsPerSecond);
+            for (unsigned int k = 0; k < limits.workingSets.size(); k++)
+                printf("%s %.0f KiB %.2f", k > 0 ? "," : "", limits.workingSets[k] / 1024.0, 1e-9 * limits.bandwidths[k]);
+            printf("\n");
+        }
+    }
+
+    std::vector<Result> results;
+    int pickingMismatches = 0;
+    for (const Configuration& configuration : configurations) {
+        Result result = run(configuration);
+        printf("%ux%u threads %d %-9s construction %9.2f ms, %9.4f ms/step, %9.1f steps/s\n",
+               configuration.nw, configuration.nh, configuration.threads, configuration.mode.c_str(),
+               result.constructionMs, result.msPerStep, 1000.0 / result.msPerStep);
+        if (result.hasCounters) {
+            // Whole step: add up the phases
+            double step[(int)PerfEvent::Count] = {};
+            for (int p = 0; p < (int)StepPhase::Count; p++)
+                for (int e = 0; e < (int)PerfEvent::Count; e++)
+                    step[e] += result.phaseCounts[p][e];
+            double particles = (double)result.particles;
+            printf("    IPC %.2f, %.1f LLC bytes/particle, %.3f LLC misses/spring, %.3f branch misses/particle per step\n",
+                   step[(int)PerfEvent::Cycles] > 0.0 ? step[(int)PerfEvent::Instructions] / step[(int)PerfEvent::Cycles] : 0.0,
+                   cacheLineBytes * step[(int)PerfEvent::CacheMisses] / particles,
+                   step[(int)PerfEvent::CacheMisses] / (double)result.springs,
+                   step[(int)PerfEvent::BranchMisses] / particles);
+        }
+        if (result.hasPicking) {
+            printf("    picking us/query (mean/worst): raycast %.2f/%.2f, nearest %.2f/%.2f, within %.2f/%.2f\n",
+                   result.pickingUs[0], result.pickingMaxUs[0], result.pickingUs[1], result.pickingMaxUs[1],
+                   result.pickingUs[2], result.pickingMaxUs[2]);
+            pickingMismatches += result.pickingMismatches;
+        }
+        fflush(stdout);
+        results.push_back(result);
+    }
+    if (roofline)
+        printRoofline(results);
+
+    if (outputPath) {
+        FILE* file = fopen(outputPath, "w");
+        if (!file) {
+            printf("ERROR::BENCH::CANNOT_WRITE %s\n", outputPath);
+            return 1;
+        }
+        fprintf(file, "{");
+        if (roofline) {
+            fprintf(file, "\"host\": [");
+            for (unsigned int i = 0; i < hostLimits.size(); i++) {
+                const HostLimits& limits = hostLimits[i];
+                fprintf(file, "%s{\"threads\": %d, \"gflops\": %.3f, \"triad\": [", i > 0 ? ", " : "",
+                        limits.threads, 1e-9 * limits.flopsPerSecond);
+                for (unsigned int k = 0; k < limits.workingSets.size(); k++)
+                    fprintf(file, "%s{\"bytes\": %.0f, \"gbytes_per_s\": %.3f}", k > 0 ? ", " : "",
+                            limits.workingSets[k], 1e-9 * limits.bandwidths[k]);
+                fprintf(file, "]}");
+            }
+            fprintf(file, "],\n");
+        }
+        fprintf(file, "\"results\": [\n");
+        for (unsigned int i = 0; i < results.size(); i++)
+            fprintf(file, "%s%s\n", toJson(results[i]).c_str(), i + 1 < results.size() ? "," : "");
+        fprintf(file, "]}\n");
+        fclose(file);
+        printf("output: %s\n", outputPath);
+    }
+
+    int status = baselinePath ? compare(results, baselinePath) : 0;
+    return pickingMismatches > 0 ? 1 : status;
+}
+
+Result run(const Configuration& configuration)
+{
+#ifdef _OPENMP
+    omp_set_num_threads(configuration.threads);
+#endif
+    const bool wind = configuration.mode == "wind";
+    const bool mixed = configuration.mode == "colliders";
+    const bool layered = configuration.mode == "cloths";
+    const bool collision = mixed || layered || configuration.mode == "collision";
+
+    // The viewer's cloth, grown at the same spacing and particle mass so every size is as stable
+    const float timeStep = 0.002f;
+    const float dx = 0.1f;
+    const float particleMass = 1.0f / 1200.0f;
+    auto clothTransform = glm::rotate(glm::mat4(1.0f), glm::radians(60.0f), {1.0f, 0.0f, 0.0f});
+
+    Result result;
+    result.configuration = configuration;
+
+    Clock::time_point start = Clock::now();
+    RectCloth cloth(configuration.nw, configuration.nh, dx, clothTransform);
+    RectClothSimulator simulator(&cloth, particleMass * (float)(configuration.nw * configuration.nh),
+                                 40.0f, 0.001f, {0.0f, -9.81f, 0.0f});
+    std::vector<RectClothSimulator*> simulators = {&simulator};
+    // 'cloths': the same cloth a little higher, falling onto the first
+    std::optional<RectCloth> upperCloth;
+    std::optional<RectClothSimulator> upperSimulator;
+    if (layered) {
+        upperCloth.emplace(configuration.nw, configuration.nh, dx,
+                           glm::translate(glm::mat4(1.0f), {0.0f, 0.4f, 0.0f}) * clothTransform);
+        upperSimulator.emplace(&*upperCloth, particleMass * (float)(configuration.nw * configuration.nh),
+                               40.0f, 0.001f, glm::vec3(0.0f, -9.81f, 0.0f));
+        simulators.push_back(&*upperSimulator);
+    }
+    result.constructionMs = millisecondsSince(start);
+
+    ClothScene scene;
+    for (RectClothSimulator* each : simulators) {
+        each->is_wind = wind;
+        each->is_aerodynamic = wind;
+        each->is_collision = collision;
+        each->is_self_collision = collision;
+        each->is_triangle_contact = collision;
+        scene.add(each);
+    }
+
+    // A ball under the middle of the cloth, sized with it
+    ColliderSet colliders;
+    float extent = 0.5f * glm::max(cloth.width, cloth.height);
+    colliders.addSphere({0.0f, -0.5f * extent - 0.3f, -0.2f * extent}, 0.4f * extent);
+    if (mixed) {
+        // Small shapes on a 6 x 4 grid around the ball, cycling through sphere, capsule and box
+        const glm::mat3 turn = glm::mat3(glm::rotate(glm::mat4(1.0f), glm::radians(30.0f), {0.0f, 1.0f, 0.0f}));
+        for (int k = 0; k < 24; k++) {
+            glm::vec3 center = {extent * (-0.8f + 0.32f * (float)(k % 6)), -0.9f * extent - 0.3f,
+                                extent * (-0.9f + 0.5f * (float)(k / 6))};
+            float size = 0.06f * extent;
+            if (k % 3 == 0)
+                colliders.addSphere(center, size);
+            else if (k % 3 == 1)
+                colliders.addCapsule(center - glm::vec3(size, 0.0f, 0.0f), center + glm::vec3(size, 0.0f, 0.0f), 0.3f * size);
+            else
+                colliders.addBox(center, glm::vec3(size), turn);
+        }
+        // Ground: a heightfield over half of it, a plane under all of it
+        const unsigned int samples = 17;
+        std::vector<float> heights(samples * samples);
+        for (unsigned int z = 0; z < samples; z++)
+            for (unsigned int x = 0; x < samples; x++)
+                heights[z * samples + x] = 0.05f * extent * sinf(0.8f * (float)x) * cosf(0.6f * (float)z);
+        colliders.addHeightfield({-1.5f * extent, -extent - 0.4f, -1.5f * extent}, 0.09375f * extent, samples, samples, heights);
+        colliders.addPlane({0.0f, -1.1f * extent - 0.4f, 0.0f}, {0.0f, 1.0f, 0.0f});
+    }
+    PhaseTimer timer;
+    for (RectClothSimulator* each : simulators) {
+        each->setColliders(&colliders);
+        each->setObserver(&timer);
+    }
+    // A lone cloth steps by itself, without the scene's pair search
+    auto step = [&]() {
+        if (layered)
+            scene.step(timeStep);
+        else
+            simulator.step(timeStep);
+    };
+
+    // One warm-up step, then steps until the time is used
+    step();
+    timer = PhaseTimer();
+    int steps = 0;
+    start = Clock::now();
+    double elapsed = 0.0;
+    while (elapsed < 1000.0 * secondsPerConfiguration || steps < 3) {
+        step();
+        steps++;
+        elapsed = millisecondsSince(start);
+    }
+
+    result.steps = steps;
+    result.msPerStep = elapsed / steps;
+    for (int p = 0; p < (int)StepPhase::Count; p++)
+        result.phaseMs[p] = timer.total[p] / steps;
+
+    result.particles = 0;
+    result.springs = 0;
+    result.hasPicking = configuration.nw * configuration.nh >= pickingMinParticles;
+    if (result.hasPicking)
+        timePicking(simulator, cloth, 3.0f * dx, result);
+    for (int p = 0; p < (int)StepPhase::Count; p++) {
+        result.phaseModelled[p] = true;
+        result.phaseBytes[p] = result.phaseFlops[p] = 0.0;
+    }
+    for (RectClothSimulator* each : simulators) {
+        result.particles += configuration.nw * configuration.nh;
+        result.springs += each->getSpringCount();
+        for (int p = 0; p < (int)StepPhase::Count; p++) {
+            double bytes = 0.0, flops = 0.0;
+            result.phaseModelled[p] = each->estimateTraffic((StepPhase)p, bytes, flops) && result.phaseModelled[p];
+            result.phaseBytes[p] += bytes;
+            result.phaseFlops[p] += flops;
+        }
+    }
+
+    // Counters in a run of their own, their reads would show in the times
+    result.hasCounters = counters != nullptr;
+    if (result.hasCounters) {
+        const int counterSteps = std::max(3, std::min(steps, 100));
+        timer = PhaseTimer();
+        timer.counters = counters;
+        for (int i = 0; i < counterSteps; i++)
+            step();
+        for (int p = 0; p < (int)StepPhase::Count; p++)
+            for (int e = 0; e < (int)PerfEvent::Count; e++)
+                result.phaseCounts[p][e] = timer.counts[p][e] / counterSteps;
+    }
+    return result;
+}
+
+std::string toJson(const Result& result)
+{
+    const Configuration& configuration = result.configuration;
+    char buffer[256];
+    snprintf(buffer, sizeof(buffer),
+             "{\"grid\": \"%ux%u\", \"particles\": %u, \"threads\": %d, \"mode\": \"%s\", "
+             "\"construction_ms\": %.4f, \"steps\": %d, \"ms_per_step\": %.6f, \"steps_per_sec\": %.3f, \"phases_ms\": {",
+             configuration.nw, configuration.nh, result.particles, configuration.threads,
+             configuration.mode.c_str(), result.constructionMs, result.steps, result.msPerStep, 1000.0 / result.msPerStep);
+    std::string json = buffer;
+    bool first = true;
+    for (int p = 0; p < (int)StepPhase::Count; p++) {
+        if (result.phaseMs[p] == 0.0)
+            continue;
+        snprintf(buffer, sizeof(buffer), "%s\"%s\": %.6f", first ? "" : ", ", stepPhaseName((StepPhase)p), result.phaseMs[p]);
+        json += buffer;
+        first = false;
+    }
+    json += "}";
+
+    if (result.hasCounters) {
+        // Per step and phase, with the derived figures
+        const double particles = (double)result.particles;
+        json += ", \"counters\": {";
+        first = true;
+        for (int p = 0; p < (int)StepPhase::Count; p++) {
+            const double* counts = result.phaseCounts[p];
+            if (result.phaseMs[p] == 0.0)
+                continue;
+            double cycles = counts[(int)PerfEvent::Cycles];
+            snprintf(buffer, sizeof(buffer), "%s\"%s\": {", first ? "" : ", ", stepPhaseName((StepPhase)p));
+            json += buffer;
+            for (int e = 0; e < (int)PerfEvent::Count; e++) {
+                snprintf(buffer, sizeof(buffer), "\"%s\": %.0f, ", perfEventName((PerfEvent)e), counts[e]);
+                json += buffer;
+            }
+            snprintf(buffer, sizeof(buffer), "\"ipc\": %.3f, \"bytes_per_particle\": %.3f, \"misses_per_spring\": %.4f}",
+                     cycles > 0.0 ? counts[(int)PerfEvent::Instructions] / cycles : 0.0,
+                     cacheLineBytes * counts[(int)PerfEvent::CacheMisses] / particles,
+                     counts[(int)PerfEvent::CacheMisses] / (double)result.springs);
+            json += buffer;
+            first = false;
+        }
+        json += "}";
+    }
+
+    const HostLimits* limits = nullptr;
+    for (const HostLimits& host : hostLimits)
+        limits = host.threads == configuration.threads ? &host : limits;
+    if (limits) {
+        json += ", \"roofline\": {";
+        first = true;
+        for (int p = 0; p < (int)StepPhase::Count; p++) {
+            if (!result.phaseModelled[p] || result.phaseMs[p] == 0.0)
+                continue;
+            double bandwidth = limits->bytesPerSecond(result.phaseBytes[p]);
+            double seconds = 1e-3 * result.phaseMs[p];
+            double intensity = result.phaseFlops[p] / result.phaseBytes[p];
+            double attainable = std::min(limits->flopsPerSecond, intensity * bandwidth);
+            snprintf(buffer, sizeof(buffer), "%s\"%s\": {\"gbytes_per_s\": %.3f, \"gflops\": %.3f, \"intensity\": %.3f, "
+                     "\"roof_gbytes_per_s\": %.3f, \"of_roofline\": %.3f}",
+                     first ? "" : ", ", stepPhaseName((StepPhase)p), 1e-9 * result.phaseBytes[p] / seconds,
+                     1e-9 * result.phaseFlops[p] / seconds, intensity, 1e-9 * bandwidth,
+                     attainable > 0.0 ? result.phaseFlops[p] / seconds / attainable : result.phaseBytes[p] / seconds / bandwidth);
+            json += buffer;
+            first = false;
+        }
+        json += "}";
+    }
+
+    if (result.hasPicking) {
+        json += ", \"picking_us\": {";
+        for (int q = 0; q < 3; q++) {
+            snprintf(buffer, sizeof(buffer), "%s\"%s\": {\"mean\": %.4f, \"worst\": %.4f}", q > 0 ? ", " : "",
+                     pickingQueryNames[q], result.pickingUs[q], result.pickingMaxUs[q]);
+            json += buffer;
+        }
+        json += "}";
+    }
+    return json + "}";
+}
+
+// Moller-Trumbore as in ClothBvh::raycast, over every intact triangle
+static bool bruteRaycast(const RectClothSimulator& simulator, const RectCloth& cloth,
+                         const glm::vec3& origin, const glm::vec3& direction, float& tHit)
+{
+    const std::vector<glm::uvec3>& triangles = cloth.getTriangles();
+    bool found = false;
+    tHit = 1e30f;
+    for (unsigned int t = 0; t < triangles.size(); t++) {
+        if (cloth.isTorn(t))
+            continue;
+        const glm::vec3& a = simulator.getPosition(triangles[t].x);
+        glm::vec3 e1 = simulator.getPosition(triangles[t].y) - a, e2 = simulator.getPosition(triangles[t].z) - a;
+        glm::vec3 q = glm::cross(direction, e2);
+        float det = glm::dot(e1, q);
+        if (glm::abs(det) < 1e-12f)
+            continue;
+        float invDet = 1.0f / det;
+        glm::vec3 s = origin - a;
+        float u = glm::dot(s, q) * invDet;
+        if (u < 0.0f || u > 1.0f)
+            continue;
+        glm::vec3 r = glm::cross(s, e1);
+        float v = glm::dot(direction, r) * invDet;
+        if (v < 0.0f || u + v > 1.0f)
+            continue;
+        float t0 = glm::dot(e2, r) * invDet;
+        if (t0 >= 0.0f && t0 < tHit) {
+            tHit = t0;
+            found = true;
+        }
+    }
+    return found;
+}
+
+void timePicking(RectClothSimulator& simulator, const RectCloth& cloth, float radius, Result& result)
+{
+    const unsigned int count = cloth.nw * cloth.nh;
+    glm::vec3 lower(1e30f), upper(-1e30f);
+    for (unsigned int i = 0; i < count; i++) {
+        lower = glm::min(lower, simulator.getPosition(i));
+        upper = glm::max(upper, simulator.getPosition(i));
+    }
+    const glm::vec3 center = 0.5f * (lower + upper);
+    const float diagonal = glm::length(upper - lower);
+
+    // Points in the cloth's box grown by a tenth of its diagonal; rays from a sphere around it aimed at such points
+    std::mt19937 generator(12345);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    auto randomPoint = [&]() {
+        glm::vec3 mix(unit(generator), unit(generator), unit(generator));
+        return lower - 0.1f * diagonal + mix * (upper - lower + 0.2f * diagonal);
+    };
+    std::vector<glm::vec3> points(pickingQueries), origins(pickingQueries), directions(pickingQueries);
+    for (int k = 0; k < pickingQueries; k++) {
+        points[k] = randomPoint();
+        glm::vec3 away = randomPoint() - center;
+        origins[k] = center + 2.0f * diagonal * glm::normalize(glm::length(away) > 0.0f ? away : glm::vec3(0.0f, 1.0f, 0.0f));
+        directions[k] = glm::normalize(randomPoint() - origins[k]);
+    }
+
+    // The first query refits the BVH for the current positions, outside the timing
+    ClothBvh::RayHit hit;
+    simulator.raycast(origins[0], directions[0], hit);
+
+    std::vector<ClothBvh::RayHit> hits(pickingQueries);
+    std::vector<char> hitFound(pickingQueries);
+    std::vector<unsigned int> nearest(pickingQueries);
+    std::vector<std::vector<unsigned int>> within(pickingQueries);
+    for (int q = 0; q < 3; q++) {
+        double total = 0.0, worst = 0.0;
+        for (int k = 0; k < pickingQueries; k++) {
+            Clock::time_point start = Clock::now();
+            if (q == 0)
+                hitFound[k] = simulator.raycast(origins[k], directions[k], hits[k]);
+            else if (q == 1)
+                simulator.nearestParticle(points[k], nearest[k]);
+            else
+                simulator.particlesWithin(points[k], radius, within[k]);
+            double us = 1000.0 * millisecondsSince(start);
+            total += us;
+            worst = std::max(worst, us);
+        }
+        result.pickingUs[q] = total / pickingQueries;
+        result.pickingMaxUs[q] = worst;
+    }
+
+    // Brute force over a share of the queries that keeps the largest grids to a few seconds
+    const int checked = std::max(8, std::min(pickingQueries, (int)(20000000u / count)));
+    result.pickingMismatches = 0;
+    for (int k = 0; k < checked; k++) {
+        float t;
+        bool found = bruteRaycast(simulator, cloth, origins[k], directions[k], t);
+        if (found != (hitFound[k] != 0) || (found && glm::abs(t - hits[k].t) > 1e-4f * (1.0f + t))) {
+            printf("ERROR::BENCH::PICKING raycast %d: %s t %g, brute force %s t %g\n", k, hitFound[k] ? "hit" : "miss",
+                   hits[k].t, found ? "hit" : "miss", t);
+            result.pickingMismatches++;
+        }
+
+        float best = 1e30f;
+        std::vector<unsigned int> inside;
+        for (unsigned int i = 0; i < count; i++) {
+            glm::vec3 d = simulator.getPosition(i) - points[k];
+            best = std::min(best, glm::length(d));
+            if (glm::dot(d, d) <= radius * radius)
+                inside.push_back(i);
+        }
+        float distance = glm::length(simulator.getPosition(nearest[k]) - points[k]);
+        if (distance != best) {
+            printf("ERROR::BENCH::PICKING nearest %d: particle %u at %g, brute force %g\n", k, nearest[k], distance, best);
+            result.pickingMismatches++;
+        }
+        std::sort(within[k].begin(), within[k].end());
+        if (within[k] != inside) {
+            printf("ERROR::BENCH::PICKING within %d: %zu particles, brute force %zu\n", k, within[k].size(), inside.size());
+            result.pickingMismatches++;
+        }
+    }
+}
+
+HostLimits probeHost(int threads)
+{
+#ifdef _OPENMP
+    omp_set_num_threads(threads);
+#endif
+    HostLimits limits = {threads, {}, {}, 0.0};
+
+    // STREAM triads over working sets of 16 KiB to 192 MiB, the last well past the last level cache.
+    //  Every timing repeats the triad for 256 MiB of traffic, back and forth between a and b so that
+    //  no pass is redundant; every thread keeps its static share of the arrays, which needs no
+    //  barrier between passes. Best of three.
+    const double workingSets[] = {16384.0, 131072.0, 1048576.0, 8388608.0, 67108864.0, 201326592.0};
+    const double totalBytes = 268435456.0;
+    for (double workingSet : workingSets) {
+        const long n = (long)(workingSet / (3.0 * sizeof(double)));
+        const long passes = std::max(1l, (long)(totalBytes / workingSet));
+        std::vector<double> a(n, 0.0), b(n, 1.0), c(n, 2.0);
+        double bandwidth = 0.0;
+        for (int repetition = 0; repetition < 3; repetition++) {
+            Clock::time_point start = Clock::now();
+            #pragma omp parallel
+            for (long pass = 0; pass < passes; pass++) {
+                double* to = pass % 2 == 0 ? a.data() : b.data();
+                const double* from = pass % 2 == 0 ? b.data() : a.data();
+                #pragma omp for schedule(static) nowait
+                for (long i = 0; i < n; i++)
+                    to[i] = from[i] + 0.5 * c[i];
+            }
+            double seconds = 1e-3 * millisecondsSince(start);
+            bandwidth = std::max(bandwidth, 3.0 * sizeof(double) * (double)n * (double)passes / seconds);
+        }
+        limits.workingSets.push_back(3.0 * sizeof(double) * (double)n);
+        limits.bandwidths.push_back(bandwidth);
+    }
+
+    // Independent multiply-add chains, enough of them to hide the latency, each a * x + b is two flops
+    const int lanes = 64;
+    const long iterations = 1l << 22;
+    double sink = 0.0;
+    for (int repetition = 0; repetition < 3; repetition++) {
+        int team = 1;
+        Clock::time_point start = Clock::now();
+        #pragma omp parallel reduction(+:sink)
+        {
+#ifdef _OPENMP
+            #pragma omp single
+            team = omp_get_num_threads();
+#endif
+            float x[lanes];
+            for (int k = 0; k < lanes; k++)
+                x[k] = (float)k;
+            const float scale = 0.9999999f, offset = 1e-7f;
+            for (long i = 0; i < iterations; i++) {
+                #pragma omp simd
+                for (int k = 0; k < lanes; k++)
+                    x[k] = x[k] * scale + offset;
+            }
+            for (int k = 0; k < lanes; k++)
+                sink += x[k];
+        }
+        double seconds = 1e-3 * millisecondsSince(start);
+        limits.flopsPerSecond = std::max(limits.flopsPerSecond, 2.0 * lanes * (double)iterations * team / seconds);
+    }
+    if (sink == 0.12345) // keeps the chains from being optimised away
+        printf(" ");
+    return limits;
+}
+
+void printRoofline(const std::vector<Result>& results)
+{
+    // Against the bandwidth of the level the phase's arrays fit in
+    printf("\nroofline (modelled traffic; of roof = achieved / min(peak, intensity * bandwidth), bandwidth of the triad at the phase's bytes):\n");
+    printf("%-10s %3s %-9s %-13s %9s %9s %10s %9s %9s %7s %s\n", "grid", "thr", "mode", "phase", "GB/s", "GFLOP/s",
+           "FLOP/byte", "set KiB", "roof GB/s", "of roof", "bound");
+    for (const Result& result : results) {
+        const Configuration& configuration = result.configuration;
+        const HostLimits* limits = nullptr;
+        for (const HostLimits& host : hostLimits)
+            limits = host.threads == configuration.threads ? &host : limits;
+        for (int p = 0; p < (int)StepPhase::Count && limits; p++) {
+            if (!result.phaseModelled[p] || result.phaseMs[p] == 0.0)
+                continue;
+            double bandwidth = limits->bytesPerSecond(result.phaseBytes[p]);
+            double seconds = 1e-3 * result.phaseMs[p];
+            double bytesPerSecond = result.phaseBytes[p] / seconds;
+            double flopsPerSecond = result.phaseFlops[p] / seconds;
+            double intensity = result.phaseFlops[p] / result.phaseBytes[p];
+            bool memoryBound = intensity * bandwidth < limits->flopsPerSecond;
+            double fraction = memoryBound ? bytesPerSecond / bandwidth : flopsPerSecond / limits->flopsPerSecond;
+            std::string grid = std::to_string(configuration.nw) + "x" + std::to_string(configuration.nh);
+            printf("%-10s %3d %-9s %-13s %9.2f %9.2f %10.3f %9.0f %9.2f %6.1f%% %s\n", grid.c_str(), configuration.threads,
+                   configuration.mode.c_str(), stepPhaseName((StepPhase)p), 1e-9 * bytesPerSecond, 1e-9 * flopsPerSecond,
+                   intensity, result.phaseBytes[p] / 1024.0, 1e-9 * bandwidth, 100.0 * fraction,
+                   memoryBound ? "memory" : "compute");
+        }
+    }
+}
+
+// The value after "key": on a result line
+static bool readField(const std::string& line, const char* key, std::string& value)
+{
+    std::string pattern = std::string("\"") + key + "\": ";
+    size_t at = line.find(pattern);
+    if (at == std::string::npos)
+        return false;
+    at += pattern.size();
+    if (line[at] == '"') {
+        size_t end = line.find('"', at + 1);
+        value = line.substr(at + 1, end - at - 1);
+    } else {
+        size_t end = line.find_first_of(",}", at);
+        value = line.substr(at, end - at);
+    }
+    return true;
+}
+
+int compare(const std::vector<Result>& results, const char* path)
+{
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        printf("ERROR::BENCH::CANNOT_READ %s\n", path);
+        return 1;
+    }
+
+    // One configuration per line, as written above
+    int regressions = 0, matched = 0;
+    char line[4096];
+    printf("comparison against %s (tolerance %.0f%%):\n", path, 100.0 * tolerance);
+    while (fgets(line, sizeof(line), file)) {
+        std::string grid, threads, mode, msPerStep;
+        if (!readField(line, "grid", grid) || !readField(line, "threads", threads) ||
+            !readField(line, "mode", mode) || !readField(line, "ms_per_step", msPerStep))
+            continue;
+        for (const Result& result : results) {
+            const Configuration& configuration = result.configuration;
+            std::string currentGrid = std::to_string(configuration.nw) + "x" + std::to_string(configuration.nh);
+            if (currentGrid != grid || configuration.threads != atoi(threads.c_str()) || configuration.mode != mode)
+                continue;
+            double baseline = atof(msPerStep.c_str());
+            double ratio = result.msPerStep / baseline;
+            bool regressed = ratio > 1.0 + tolerance;
+            printf("  %s threads %s %-9s %9.4f -> %9.4f ms/step (%+.1f%%)%s\n", grid.c_str(), threads.c_str(), mode.c_str(),
+                   baseline, result.msPerStep, 100.0 * (ratio - 1.0), regressed ? "  REGRESSION" : "");
+            regressions += regressed ? 1 : 0;
+            matched++;
+        }
+    }
+    fclose(file);
+    printf("%d of %d matched configurations regressed\n", regressions, matched);
+    return regressions > 0 ? 1 : 0;
+}
+
+// Comma separated list, e.g. "40x30,256x256"
+static std::vector<std::string> splitList(const char* list)
+{
+    std::vector<std::string> items;
+    std::string current;
+    for (const char* c = list; ; c++) {
+        if (*c == ',' || *c == '\0') {
+            if (!current.empty())
+                items.push_back(current);
+            current.clear();
+            if (*c == '\0')
+                break;
+        } else {
+            current += *c;
+        }
+    }
+    return items;
+}
+
+void parseParameters(int argc, char* argv[])
+{
+    std::vector<std::string> grids = {"40x30", "128x128", "512x512", "2048x2048"};
+    std::vector<std::string> modes = {"hang", "wind", "collision"};
+    std::vector<int> threads = {1};
+#ifdef _OPENMP
+    if (omp_get_max_threads() > 1)
+        threads.push_back(omp_get_max_threads());
+#endif
+
+    for (int i = 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "--grids") == 0 && hasValue) {
+            grids = splitList(argv[++i]);
+        } else if (strcmp(argv[i], "--modes") == 0 && hasValue) {
+            modes = splitList(argv[++i]);
+        } else if (strcmp(argv[i], "--threads") == 0 && hasValue) {
+            threads.clear();
+            for (const std::string& item : splitList(argv[++i]))
+                threads.push_back(atoi(item.c_str()));
+        } else if (strcmp(argv[i], "--seconds") == 0 && hasValue) {
+            secondsPerConfiguration = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--out") == 0 && hasValue) {
+            outputPath = argv[++i];
+        } else if (strcmp(argv[i], "--compare") == 0 && hasValue) {
+            baselinePath = argv[++i];
+        } else if (strcmp(argv[i], "--tolerance") == 0 && hasValue) {
+            tolerance = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--roofline") == 0) {
+            roofline = true;
+        } else {
+            printf("Invalid parameter %s, please check your spelling.\n", argv[i]);
+            exit(1);
+        }
+    }
+
+    for (const std::string& grid : grids) {
+        unsigned int nw = 0, nh = 0;
+        if (sscanf(grid.c_str(), "%ux%u", &nw, &nh) != 2 || nw < 2 || nh < 2) {
+            printf("Invalid grid %s, expected e.g. 40x30.\n", grid.c_str());
+            exit(1);
+        }
+        for (const std::string& mode : modes) {
+            if (mode != "hang" && mode != "wind" && mode != "collision" && mode != "colliders" && mode != "cloths") {
+                printf("Invalid mode %s, expected hang, wind, collision, colliders or cloths.\n", mode.c_str());
+                exit(1);
+            }
+            for (int count : threads)
+                configurations.push_back({nw, nh, std::max(count, 1), mode});
+        }
+    }
+}
@@ -0,0 +1,266 @@
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <optional>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "allocation_tracker.hpp"
+#include "cloth_scene.hpp"
+#include "cloth_simulator.hpp"
+
+// Runs one of the viewer's scenes without a window:
+//  cloth_headless [hang|wind|windgrid|collision|ccd|colliders|sdf|cloths|barrier|tear] [steps] [output.obj]
+// and prints construction and stepping times, then a summary of the final state. 'colliders' is
+// the collision scene with a capsule, a box, a heightfield and a floor plane besides the ball;
+// 'sdf' adds a torus under the ball as a distance field, built, saved and loaded back (mapped);
+// 'ccd' is the collision scene with continuous collision against the ball and the cloth itself;
+// 'cloths' drops a second cloth onto the first, the two colliding through a ClothScene.
+
+void parseParameters(int argc, char* argv[]);
+void writeObj(const char* path, const RectCloth& cloth);
+void torusMesh(float major, float minor, std::vector<glm::vec3>& vertices, std::vector<glm::uvec3>& triangles);
+
+const char* scene = "hang";
+int steps = 1000;
+const char* outputPath = nullptr;
+
+using Clock = std::chrono::steady_clock;
+
+static double millisecondsSince(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+int main(int argc, char* argv[])
+{
+    parseParameters(argc, argv);
+    const bool windGrid = strcmp(scene, "windgrid") == 0;
+    const bool wind = windGrid || strcmp(scene, "wind") == 0;
+    const bool barrier = strcmp(scene, "barrier") == 0;
+    const bool mixed = strcmp(scene, "colliders") == 0;
+    const bool sdf = strcmp(scene, "sdf") == 0;
+    const bool ccd = strcmp(scene, "ccd") == 0;
+    const bool layered = strcmp(scene, "cloths") == 0;
+    const bool collision = barrier || mixed || sdf || ccd || layered || strcmp(scene, "collision") == 0;
+    const bool tear = strcmp(scene, "tear") == 0;
+
+    // Same settings as the viewer
+    const float timeStep = 0.002f;
+    unsigned int nWidth = 40;
+    unsigned int nHeight = 30;
+    float dx = 0.1f;
+    auto clothTransform = glm::rotate(glm::mat4(1.0f), glm::radians(60.0f), {1.0f, 0.0f, 0.0f});
+    float totalMass = 1.0f;
+    float stiffnessReference = 40.0f;
+    float airResistanceCoefficient = 0.001f;
+    glm::vec3 gravity = {0.0f, -9.81f, 0.0f};
+
+    Clock::time_point start = Clock::now();
+    // Ends once everything is built, the objects themselves must outlive it
+    std::optional<AllocationScope> constructionAllocations(std::in_place, "construction");
+    RectCloth cloth(nWidth, nHeight, dx, clothTransform);
+    RectClothSimulator simulator(&cloth, totalMass, stiffnessReference, airResistanceCoefficient, gravity);
+    auto configure = [&](RectClothSimulator& each) {
+        each.is_wind = wind;
+        each.is_collision = collision;
+        each.is_aerodynamic = wind;
+        each.is_self_collision = collision;
+        each.is_triangle_contact = collision;
+        each.is_barrier = barrier;
+        each.is_tearing = tear;
+        each.is_ccd = ccd;
+        each.setTearStrain(0.3f);
+    };
+    configure(simulator);
+    // The same cloth a little higher and to the side, falling onto the first
+    std::optional<RectCloth> upperCloth;
+    std::optional<RectClothSimulator> upperSimulator;
+    ClothScene clothScene;
+    clothScene.add(&simulator);
+    if (layered) {
+        upperCloth.emplace(nWidth, nHeight, dx, glm::translate(glm::mat4(1.0f), {0.3f, 0.4f, 0.0f}) * clothTransform);
+        upperSimulator.emplace(&*upperCloth, totalMass, stiffnessReference, airResistanceCoefficient, gravity);
+        configure(*upperSimulator);
+        clothScene.add(&*upperSimulator);
+    }
+
+    const glm::vec3 ballCenter = {0.1f, -2.0f, -0.3f};
+    ColliderSet colliders;
+    unsigned int ball = colliders.addSphere(ballCenter, 1.0f);
+    if (mixed) {
+        // Every other shape somewhere the falling cloth reaches, the capsule thinner than the spacing
+        colliders.addCapsule({-1.5f, -2.7f, 0.7f}, {1.5f, -2.7f, 0.7f}, 0.04f);
+        colliders.addBox({-1.0f, -3.0f, -0.6f}, {0.3f, 0.25f, 0.3f},
+                         glm::mat3(glm::rotate(glm::mat4(1.0f), glm::radians(30.0f), {0.0f, 1.0f, 0.0f})));
+        // Bumpy ground on the left half, a flat floor plane under the rest
+        const unsigned int nx = 13, nz = 25;
+        std::vector<float> heights(nx * nz);
+        for (unsigned int z = 0; z < nz; z++)
+            for (unsigned int x = 0; x < nx; x++)
+                heights[z * nx + x] = 0.15f * sinf(0.8f * (float)x) * cosf(0.6f * (float)z);
+        colliders.addHeightfield({-3.0f, -3.3f, -3.0f}, 0.25f, nx, nz, heights);
+        colliders.addPlane({0.0f, -3.35f, 0.0f}, {0.0f, 1.0f, 0.0f});
+    }
+    // The field goes through a file the way an offline build would hand it over
+    SignedDistanceField field;
+    if (sdf) {
+        std::vector<glm::vec3> vertices;
+        std::vector<glm::uvec3> triangles;
+        torusMesh(1.2f, 0.3f, vertices, triangles);
+        SignedDistanceField built;
+        built.build(vertices, triangles, 0.05f);
+        std::filesystem::path fieldPath = std::filesystem::temp_directory_path() / "cloth_headless_torus.sdf";
+        if (!built.save(fieldPath.string()) || !field.load(fieldPath.string()))
+            return 1;
+        std::filesystem::remove(fieldPath);
+        colliders.addSdf(&field, {0.1f, -3.2f, -0.3f});
+    }
+    simulator.setColliders(&colliders);
+    if (layered)
+        upperSimulator->setColliders(&colliders);
+
+    WindGrid airGrid({24, 20, 24}, {-3.0f, -4.0f, -3.0f}, 0.25f, {0.0f, 0.0f, 2.0f});
+    if (windGrid)
+        simulator.setWindGrid(&airGrid);
+    double constructionTime = millisecondsSince(start);
+    constructionAllocations.reset();
+
+    // The air is advanced once per (60 Hz) frame, as in the viewer
+    const int stepsPerFrame = (int)roundf(1.0f / 60.0f / timeStep);
+    double slowestStep = 0.0;
+    std::optional<AllocationScope> steppingAllocations(std::in_place, "stepping");
+    start = Clock::now();
+    for (int i = 0; i < steps; ++i) {
+        Clock::time_point stepStart = Clock::now();
+        if (windGrid && i % stepsPerFrame == 0)
+            airGrid.step((float)stepsPerFrame * timeStep);
+        if (collision) {
+            float t = (float)(i + 1) * timeStep;
+            glm::vec3 sway = {0.3f * sinf(0.5f * t), 0.0f, 0.0f};
+            colliders.moveTo(ball, ballCenter + sway, glm::mat3(1.0f), timeStep);
+            colliders.advance(timeStep);
+        }
+        if (layered)
+            clothScene.step(timeStep);
+        else
+            simulator.step(timeStep);
+        double stepTime = millisecondsSince(stepStart);
+        if (stepTime > slowestStep)
+            slowestStep = stepTime;
+    }
+    double totalTime = millisecondsSince(start);
+    steppingAllocations.reset();
+
+    glm::vec3 lower(1e30f), upper(-1e30f), sum(0.0f);
+    for (const glm::vec3& p : cloth.getPositions()) {
+        lower = glm::min(lower, p);
+        upper = glm::max(upper, p);
+        sum += p;
+    }
+    glm::vec3 mean = sum / (float)cloth.getPositions().size();
+
+    printf("scene: %s, %ux%u particles, %d steps of %g s (simulated %g s)\n",
+           scene, nWidth, nHeight, steps, timeStep, simulator.getTime());
+    printf("construction: %.3f ms\n", constructionTime);
+    printf("stepping: %.3f ms total, %.4f ms/step, slowest %.4f ms, %.1f steps/s\n",
+           totalTime, totalTime / steps, slowestStep, steps / (totalTime / 1000.0));
+    printf("bounds: (%.4f, %.4f, %.4f) - (%.4f, %.4f, %.4f), mean (%.4f, %.4f, %.4f)\n",
+           lower.x, lower.y, lower.z, upper.x, upper.y, upper.z, mean.x, mean.y, mean.z);
+
+    StepHealth health = simulator.getHealth();
+    printf("health: strain max %.4f mean %.4f, kinetic %.5f J, %u contacts, %u pinned",
+           health.maxStrain, health.meanStrain, health.kineticEnergy, health.contacts, health.pinned);
+    if (barrier)
+        printf(", newton %u (cg %u), residual %.3f", health.newtonIterations, health.cgIterations, health.newtonResidual);
+    printf("\n");
+    if (layered) {
+        // Closest pair of particles across the two cloths, which the scene keeps apart
+        float closest = 1e30f;
+        for (const glm::vec3& p : cloth.getPositions())
+            for (const glm::vec3& q : upperCloth->getPositions())
+                closest = glm::min(closest, glm::length(p - q));
+        health = upperSimulator->getHealth();
+        printf("upper cloth: strain max %.4f mean %.4f, kinetic %.5f J, %u contacts; closest particles %.4f apart\n",
+               health.maxStrain, health.meanStrain, health.kineticEnergy, health.contacts, closest);
+    }
+
+    MemoryFootprint memory = simulator.memoryFootprint();
+    printf("memory: %.1f KiB (particles %.1f, topology %.1f, scratch %.1f, vertices %.1f)\n",
+           memory.total() / 1024.0, memory.particles / 1024.0, memory.topology / 1024.0,
+           memory.scratch / 1024.0, memory.vertices / 1024.0);
+#ifdef CLOTH_TRACK_ALLOCATIONS
+    printAllocationReport();
+#endif
+
+    if (outputPath)
+        writeObj(outputPath, cloth);
+    return 0;
+}
+
+// Closed torus around the y axis
+void torusMesh(float major, float minor, std::vector<glm::vec3>& vertices, std::vector<glm::uvec3>& triangles)
+{
+    const unsigned int around = 48, across = 16;
+    for (unsigned int i = 0; i < around; i++) {
+        float u = 2.0f * glm::pi<float>() * (float)i / (float)around;
+        for (unsigned int j = 0; j < across; j++) {
+            float v = 2.0f * glm::pi<float>() * (float)j / (float)across;
+            float r = major + minor * cosf(v);
+            vertices.push_back({r * cosf(u), minor * sinf(v), r * sinf(u)});
+        }
+    }
+    for (unsigned int i = 0; i < around; i++) {
+        for (unsigned int j = 0; j < across; j++) {
+            unsigned int a = i * across + j, b = ((i + 1) % around) * across + j;
+            unsigned int c = ((i + 1) % around) * across + (j + 1) % across, d = i * across + (j + 1) % across;
+            triangles.push_back({a, c, b});
+            triangles.push_back({a, d, c});
+        }
+    }
+}
+
+void writeObj(const char* path, const RectCloth& cloth)
+{
+    FILE* file = fopen(path, "w");
+    if (!file) {
+        printf("ERROR::HEADLESS::CANNOT_WRITE %s\n", path);
+        return;
+    }
+    for (const glm::vec3& p : cloth.getPositions())
+        fprintf(file, "v %f %f %f\n", p.x, p.y, p.z);
+    const std::vector<glm::uvec3>& triangles = cloth.getTriangles();
+    for (unsigned int t = 0; t < triangles.size(); t++) {
+        if (!cloth.isTorn(t))
+            fprintf(file, "f %u %u %u\n", triangles[t].x + 1, triangles[t].y + 1, triangles[t].z + 1);
+    }
+    fclose(file);
+    printf("output: %s\n", path);
+}
+
+void parseParameters(int argc, char* argv[])
+{
+    const char* scenes[] = {"hang", "wind", "windgrid", "collision", "ccd", "colliders", "sdf", "cloths", "barrier", "tear"};
+    if (argc >= 2) {
+        scene = argv[1];
+        bool known = false;
+        for (const char* name : scenes)
+            known = known || strcmp(scene, name) == 0;
+        if (!known) {
+            printf("Invalid scene, expected hang, wind, windgrid, collision, ccd, colliders, sdf, cloths, barrier or tear.\n");
+            exit(1);
+        }
+    }
+    if (argc >= 3) {
+        steps = atoi(argv[2]);
+        if (steps <= 0) {
+            printf("Invalid number of steps.\n");
+            exit(1);
+        }
+    }
+    if (argc >= 4)
+        outputPath = argv[3];
+}
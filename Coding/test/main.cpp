@@ -7,10 +7,12 @@
 #include "cloth_renderer.hpp"
 #include "cloth_simulator.hpp"
 #include "ball_renderer.hpp"
+#include "trace.hpp"
 
 void processCameraInput(GLFWwindow* window, FirstPersonCamera* camera);
+void processPickingInput(GLFWwindow* window, FirstPersonCamera* camera, RectClothSimulator* simulator);
 void parseParameters(int argc, char* argv[]);
-bool wind = false, collision = false;
+bool wind = false, collision = false, windGrid = false, barrier = false, tear = false;
 
 int main(int argc, char* argv[])
 {
@@ -84,11 +86,29 @@ int main(int argc, char* argv[])
         RectClothRenderer renderer(&shader, &camera, &cloth);
         RectClothSimulator simulator(&cloth, totalMass, stiffnessReference, airResistanceCoefficient, gravity);
         
-        // For bonus part
-        Shader ball_shader(vertexShader, "../res/shader/ball.fs");
-        BallRenderer ball_renderer(&ball_shader, &camera);
         simulator.is_wind = wind;
         simulator.is_collision = collision;
+        simulator.is_aerodynamic = wind;
+        simulator.is_self_collision = collision;
+        simulator.is_triangle_contact = collision;
+        simulator.is_barrier = barrier;
+        simulator.is_tearing = tear;
+        simulator.setTearStrain(0.3f); // the pinned corners give way
+
+        // The ball sways slowly under the cloth; the simulator and its renderer share it
+        const glm::vec3 ballCenter = {0.1f, -2.0f, -0.3f};
+        ColliderSet colliders;
+        unsigned int ball = colliders.addSphere(ballCenter, 1.0f);
+        simulator.setColliders(&colliders);
+
+        // For bonus part
+        Shader ball_shader(vertexShader, "../res/shader/ball.fs");
+        BallRenderer ball_renderer(&ball_shader, &camera, &colliders, ball);
+
+        // Coarse air grid around the cloth, coupled both ways when requested
+        WindGrid airGrid({24, 20, 24}, {-3.0f, -4.0f, -3.0f}, 0.25f, {0.0f, 0.0f, 2.0f});
+        if (windGrid)
+            simulator.setWindGrid(&airGrid);
 
         // Setup iteration variables
         float currentTime = (float)glfwGetTime();
@@ -99,13 +119,23 @@ int main(int argc, char* argv[])
         float totalIterTime = 0.0f;
         float overTakenTime = 0.0f;
 
+        bool traceKeyDown = false;
+
         // Loop until the user closes the window
         while (!glfwWindowShouldClose(window))
         {
+            CLOTH_TRACE_SCOPE("frame");
+
             // Terminate condition
             if(glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
                 glfwSetWindowShouldClose(window, true);
 
+            // T writes the recorded trace (traced builds only), once per press
+            bool traceKey = glfwGetKey(window, GLFW_KEY_T) == GLFW_PRESS;
+            if (traceKey && !traceKeyDown)
+                traceDump("cloth_trace.json");
+            traceKeyDown = traceKey;
+
             // Updating
             {
                 // Calculate dt
@@ -115,19 +145,33 @@ int main(int argc, char* argv[])
                 lastTime = currentTime;
 
                 processCameraInput(window, &camera);
+                processPickingInput(window, &camera, &simulator);
 
                 // Debug Update here only when p is pressed
                 if(glfwGetKey(window, GLFW_KEY_P) == GLFW_PRESS)
                 {
+                    CLOTH_TRACE_SCOPE("simulate");
                     // A fixed time step which should not be too large in order to stabilize the simulation
                     totalIterTime += deltaTime;
                     float curIterTime = totalIterTime - (float)totalIterCount * timeStep;
                     int iterCount = (int)roundf(curIterTime / timeStep);
 
+                    // The air is advanced once per frame, the cloth as many steps as needed
+                    if (windGrid)
+                        airGrid.step(deltaTime);
+
+                    // Where the ball should be once this frame's steps are done
+                    if (collision && iterCount > 0) {
+                        float t = (float)(totalIterCount + iterCount) * timeStep;
+                        glm::vec3 sway = {0.3f * sinf(0.5f * t), 0.0f, 0.0f};
+                        colliders.moveTo(ball, ballCenter + sway, glm::mat3(1.0f), (float)iterCount * timeStep);
+                    }
+
                     for (int i = 0; i < iterCount; ++i) {
                         totalIterCount += 1;
 
                         // Simulate one step
+                        colliders.advance(timeStep);
                         simulator.step(timeStep);
 
                         float timeTaken = static_cast<float>(glfwGetTime()) - currentTime;
@@ -147,7 +191,10 @@ int main(int argc, char* argv[])
                 ball_renderer.draw();
 
             // Swap front and back buffers
-            glfwSwapBuffers(window);
+            {
+                CLOTH_TRACE_SCOPE("swap");
+                glfwSwapBuffers(window);
+            }
 
             // Poll for and process events
             glfwPollEvents();
@@ -224,13 +271,52 @@ void processCameraInput(GLFWwindow* window, FirstPersonCamera* camera)
     lastFrame = currentFrame;
 }
 
+void processPickingInput(GLFWwindow* window, FirstPersonCamera* camera, RectClothSimulator* simulator)
+{
+    // Depth of the grabbed point along the cursor ray, kept while dragging
+    static float grabDepth {0};
+
+    if (glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) != GLFW_PRESS) {
+        simulator->release();
+        return;
+    }
+
+    // Cursor ray through the near and far planes
+    double cursorX, cursorY;
+    glfwGetCursorPos(window, &cursorX, &cursorY);
+    int width, height;
+    glfwGetWindowSize(window, &width, &height);
+    glm::vec2 ndc = {2.0f * (float)cursorX / (float)width - 1.0f, 1.0f - 2.0f * (float)cursorY / (float)height};
+    glm::mat4 inverse = glm::inverse(camera->getProjection() * camera->getView());
+    glm::vec4 nearPoint = inverse * glm::vec4(ndc, -1.0f, 1.0f);
+    glm::vec4 farPoint = inverse * glm::vec4(ndc, 1.0f, 1.0f);
+    glm::vec3 origin = glm::vec3(nearPoint) / nearPoint.w;
+    glm::vec3 direction = glm::normalize(glm::vec3(farPoint) / farPoint.w - origin);
+
+    if (simulator->isGrabbing()) {
+        simulator->moveGrab(origin + grabDepth * direction);
+        return;
+    }
+
+    // Grab the particle closest to where the ray hits the cloth
+    ClothBvh::RayHit hit;
+    unsigned int particle;
+    if (simulator->raycast(origin, direction, hit) && simulator->nearestParticle(origin + hit.t * direction, particle)) {
+        grabDepth = hit.t;
+        simulator->grab(particle, simulator->getPosition(particle));
+    }
+}
+
 void parseParameters(int argc, char* argv[])
 {
     if (argc == 2) {
         // if input is "wind"
-        wind = strcmp(argv[1], "wind") == 0;
-        collision = strcmp(argv[1], "collision") == 0;
-        if (!wind && !collision) {
+        windGrid = strcmp(argv[1], "windgrid") == 0;
+        wind = windGrid || strcmp(argv[1], "wind") == 0;
+        barrier = strcmp(argv[1], "barrier") == 0;
+        tear = strcmp(argv[1], "tear") == 0;
+        collision = barrier || strcmp(argv[1], "collision") == 0;
+        if (!wind && !collision && !tear) {
             printf("Invalid parameters, please check your spelling.\n");
             exit(1);
         }
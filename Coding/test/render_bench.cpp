@@ -0,0 +1,193 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#ifdef CLOTH_RENDER_BENCH_GL
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#endif
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "cloth_mesh.hpp"
+#include "cloth_simulator.hpp"
+
+// Cost of the cloth renderer's per-frame CPU work next to the simulation it draws:
+//  cloth_render_bench [--grids 40x30,256x256] [--seconds 0.5]
+// Vertex preparation (position copy, normal accumulation and normalisation, index generation) is
+// timed on its own; with the viewer built and a GL context available (e.g. a software one), the
+// uploads draw() issues are timed as well. Simulation cost is per 60 Hz frame of 2 ms steps.
+
+using Clock = std::chrono::steady_clock;
+
+std::vector<std::string> grids = {"40x30", "128x128", "512x512", "1024x1024"};
+double secondsPerMeasurement = 0.5;
+
+void parseParameters(int argc, char* argv[]);
+
+// Average milliseconds of 'work' over repetitions that last at least the configured time
+template <typename Work>
+static double measure(Work work)
+{
+    work(); // warm-up
+    int repetitions = 0;
+    double elapsed = 0.0;
+    Clock::time_point start = Clock::now();
+    while (elapsed < 1000.0 * secondsPerMeasurement || repetitions < 3) {
+        work();
+        repetitions++;
+        elapsed = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+    return elapsed / repetitions;
+}
+
+#ifdef CLOTH_RENDER_BENCH_GL
+// An invisible window for its context, nullptr when there is no display or GL driver
+static GLFWwindow* createContext()
+{
+    if (!glfwInit())
+        return nullptr;
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+#ifdef __APPLE__
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif
+    GLFWwindow* window = glfwCreateWindow(64, 64, "cloth_render_bench", NULL, NULL);
+    if (!window) {
+        glfwTerminate();
+        return nullptr;
+    }
+    glfwMakeContextCurrent(window);
+    if (!gladLoadGL()) {
+        glfwDestroyWindow(window);
+        glfwTerminate();
+        return nullptr;
+    }
+    return window;
+}
+#endif
+
+int main(int argc, char* argv[])
+{
+    parseParameters(argc, argv);
+
+    bool upload = false;
+#ifdef CLOTH_RENDER_BENCH_GL
+    GLFWwindow* window = createContext();
+    upload = window != nullptr;
+    if (upload)
+        printf("GL: %s, %s\n", (const char*)glGetString(GL_RENDERER), (const char*)glGetString(GL_VERSION));
+    else
+        printf("GL: no context available, uploads are not measured\n");
+#else
+    printf("GL: viewer not built, uploads are not measured\n");
+#endif
+
+    printf("%-10s %9s %9s %9s %9s %9s %9s %9s %9s\n", "grid", "positions", "accum", "normalize", "indices",
+           "cpu/frame", "upload", "sim/frame", "renderer");
+    for (const std::string& grid : grids) {
+        unsigned int nw = 0, nh = 0;
+        sscanf(grid.c_str(), "%ux%u", &nw, &nh);
+
+        auto clothTransform = glm::rotate(glm::mat4(1.0f), glm::radians(60.0f), {1.0f, 0.0f, 0.0f});
+        RectCloth cloth(nw, nh, 0.1f, clothTransform);
+        RectClothSimulator simulator(&cloth, (float)(nw * nh) / 1200.0f, 40.0f, 0.001f, {0.0f, -9.81f, 0.0f});
+        // Some motion, so positions and normals are not the flat initial ones
+        for (int i = 0; i < 20; i++)
+            simulator.step(0.002f);
+
+        ClothMesh mesh(&cloth);
+        double positions = measure([&] { mesh.updatePositions(); });
+        // The face normals are cached until a position changes, a frame always follows a step
+        double accumulate = measure([&] {
+            cloth.setPosition(0, cloth.getPosition(0));
+            mesh.accumulateNormals();
+        });
+        double normalize = measure([&] { mesh.normalizeNormals(); });
+        double indices = measure([&] { mesh.initIndices(); });
+        double perFrame = positions + accumulate + normalize;
+
+        double uploadTime = 0.0;
+#ifdef CLOTH_RENDER_BENCH_GL
+        if (upload) {
+            // The vertex upload draw() issues every frame; glFinish so the copy is not deferred
+            GLuint buffer;
+            glGenBuffers(1, &buffer);
+            glBindBuffer(GL_ARRAY_BUFFER, buffer);
+            const std::vector<ClothMesh::Vertex>& vertices = mesh.getVertices();
+            uploadTime = measure([&] {
+                glBufferData(GL_ARRAY_BUFFER, sizeof(ClothMesh::Vertex) * vertices.size(), vertices.data(), GL_STREAM_DRAW);
+                glFinish();
+            });
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+            glDeleteBuffers(1, &buffer);
+        }
+#endif
+
+        const int stepsPerFrame = 8;
+        double simulation = stepsPerFrame * measure([&] { simulator.step(0.002f); });
+        double renderer = perFrame + uploadTime;
+
+        char uploadText[16] = "-";
+        if (upload)
+            snprintf(uploadText, sizeof(uploadText), "%.4f", uploadTime);
+        printf("%-10s %9.4f %9.4f %9.4f %9.4f %9.4f %9s %9.3f %8.1f%%\n", grid.c_str(), positions, accumulate,
+               normalize, indices, perFrame, uploadText, simulation, 100.0 * renderer / (renderer + simulation));
+        fflush(stdout);
+    }
+    printf("times in ms; indices are only rebuilt on construction, renderer is its share of a frame\n");
+
+#ifdef CLOTH_RENDER_BENCH_GL
+    if (window) {
+        glfwDestroyWindow(window);
+        glfwTerminate();
+    }
+#endif
+    return 0;
+}
+
+// Comma separated list, e.g. "40x30,256x256"
+static std::vector<std::string> splitList(const char* list)
+{
+    std::vector<std::string> items;
+    std::string current;
+    for (const char* c = list; ; c++) {
+        if (*c == ',' || *c == '\0') {
+            if (!current.empty())
+                items.push_back(current);
+            current.clear();
+            if (*c == '\0')
+                break;
+        } else {
+            current += *c;
+        }
+    }
+    return items;
+}
+
+void parseParameters(int argc, char* argv[])
+{
+    for (int i = 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "--grids") == 0 && hasValue) {
+            grids = splitList(argv[++i]);
+        } else if (strcmp(argv[i], "--seconds") == 0 && hasValue) {
+            secondsPerMeasurement = atof(argv[++i]);
+        } else {
+            printf("Invalid parameter %s, please check your spelling.\n", argv[i]);
+            exit(1);
+        }
+    }
+
+    for (const std::string& grid : grids) {
+        unsigned int nw = 0, nh = 0;
+        if (sscanf(grid.c_str(), "%ux%u", &nw, &nh) != 2 || nw < 2 || nh < 2) {
+            printf("Invalid grid %s, expected e.g. 40x30.\n", grid.c_str());
+            exit(1);
+        }
+    }
+}